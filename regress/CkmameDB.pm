@@ -66,6 +66,7 @@ sub new {
 	}
 
 	$self->{dump_got} = [];
+	$self->{journal_mode} = 'delete';
 	$self->{dump_archives} = {};
 	$self->{max_id} = 0;
 	$self->{archives_got} = {};
@@ -122,6 +123,10 @@ sub read_db {
 			}
 			next;
 		}
+		if ($line =~ m/^>>> pragma journal_mode (\w+)/) {
+			$self->{journal_mode} = $1;
+			next;
+		}
 		push @{$self->{dump_got}}, $line;
 		if ($line =~ m/>>> table (\w+)/) {
 			$table = $1;
@@ -93,6 +93,14 @@ main(int argc, char *argv[]) {
 
 
 static void dump_db(sqlite3 *db) {
+    {
+        /* only shown if not the default, so dumps of databases in rollback journal mode are unchanged */
+        auto stmt = DBStatement(db, "pragma journal_mode");
+        if (stmt.step() && stmt.get_string("journal_mode") != "delete") {
+            printf(">>> pragma journal_mode %s\n", stmt.get_string("journal_mode").c_str());
+        }
+    }
+
     auto stmt = DBStatement(db, "select name from sqlite_master where type='table' and name not like 'sqlite_%' order by name");
 
     while (stmt.step()) {
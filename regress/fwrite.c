@@ -32,6 +32,7 @@
 */
 
 #include <errno.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -44,6 +45,7 @@ static size_t max_write = 0;
 static size_t (*real_fwrite)(const void *ptr, size_t size, size_t nmemb, FILE *stream) = NULL;
 static int (*real_link)(const char *src, const char *dest) = NULL;
 static int (*real_rename)(const char *src, const char *dest) = NULL;
+static struct zip *(*real_zip_open)(const char *name, int flags, int *errorp) = NULL;
 #if 0
 static size_t (*real_write)(int d, const void *buf, size_t nbytes) = NULL;
 #endif
@@ -123,6 +125,23 @@ rename(const char *src, const char *dest) {
     return real_rename(src, dest);
 }
 
+struct zip *
+zip_open(const char *name, int flags, int *errorp) {
+    if (real_zip_open == NULL) {
+	real_zip_open = dlsym(RTLD_NEXT, "zip_open");
+	if (!real_zip_open)
+	    abort();
+    }
+
+    if (getenv("ZIP_OPEN_INTERRUPTS") != NULL) {
+	if (strcmp(getenv("ZIP_OPEN_INTERRUPTS"), name) == 0) {
+	    raise(SIGINT);
+	}
+    }
+
+    return real_zip_open(name, flags, errorp);
+}
+
 #if 0
 ssize_t
 write(int d, const void *buf, size_t nbytes) {
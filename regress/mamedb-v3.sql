@@ -0,0 +1,51 @@
+create table dat (
+    dat_idx integer primary key,
+    name text,
+    description text,
+    author text,
+    version text
+);
+
+create table game (
+    game_id integer primary key autoincrement,
+    name text not null,
+        parent text,
+    description text,
+    dat_idx integer not null
+);
+create index game_name on game (name);
+
+create table file (
+    game_id integer,
+    file_type integer,
+    file_idx integer,
+    name text not null,
+    merge text,
+    status integer not null,
+    location integer not null,
+    size integer,
+    crc integer,
+    md5 binary,
+    sha1 binary,
+    primary key (game_id, file_type, file_idx)
+);
+create index file_game_type on file (game_id, file_type);
+
+create table rule (
+    rule_idx integer primary key,
+    start_offset integer,
+    end_offset integer,    
+    operation integer
+);
+
+create table test (
+    rule_idx integer,
+    test_idx integer,
+    type integer not null,
+    offset integer,
+    size integer,
+    mask binary,
+    value binary,
+    result integer not null,
+    primary key (rule_idx, test_idx)
+);
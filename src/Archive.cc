@@ -34,8 +34,13 @@
 #include "Archive.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cerrno>
+#include <condition_variable>
 #include <cstring>
+#include <mutex>
+#include <system_error>
+#include <thread>
 #include <utility>
 
 #include "config.h"
@@ -51,18 +56,60 @@
 #include "file_util.h"
 #include "globals.h"
 #include "MemDB.h"
+#include "Performance.h"
 #include "RomDB.h"
 #include "CkmameCache.h"
 
 #define BUFSIZE 8192
+#define DEFAULT_HASH_THREAD_THRESHOLD (1024 * 1024)
+#define HASH_PIPELINE_BUFFERS 3
+#define HASH_PIPELINE_BLOCK_SIZE (1024 * 1024)
+#define DEFAULT_MAX_OPEN_ARCHIVES 32
 
 //#define DEBUG_LC
 
 bool Archive::read_only_mode = false;
+size_t Archive::hash_thread_threshold = DEFAULT_HASH_THREAD_THRESHOLD;
+size_t Archive::max_open_archives = DEFAULT_MAX_OPEN_ARCHIVES;
+std::list<ArchivePtr> Archive::recently_used;
+std::unordered_map<const Archive *, std::list<ArchivePtr>::iterator> Archive::recently_used_index;
+uint64_t Archive::reuse_hits = 0;
+uint64_t Archive::reuse_misses = 0;
+
+/* Reader threads of get_hashes_pipelined() currently running, at most one per CPU core across all workers. */
+static std::atomic<size_t> hash_reader_threads(0);
+
+/* Slot for one reader thread, held while the thread runs. */
+class HashReaderThreadSlot {
+  public:
+    HashReaderThreadSlot();
+    ~HashReaderThreadSlot();
+
+    bool acquired;
+};
+
+HashReaderThreadSlot::HashReaderThreadSlot() : acquired(false) {
+    static const auto max_threads = static_cast<size_t>(std::max(std::thread::hardware_concurrency(), 1u));
+
+    auto count = hash_reader_threads.load();
+    while (count < max_threads) {
+        if (hash_reader_threads.compare_exchange_weak(count, count + 1)) {
+            acquired = true;
+            break;
+        }
+    }
+}
+
+HashReaderThreadSlot::~HashReaderThreadSlot() {
+    if (acquired) {
+        hash_reader_threads -= 1;
+    }
+}
 
 uint64_t ArchiveContents::next_id = 0;
 std::unordered_map<ArchiveContents::TypeAndName, std::weak_ptr<ArchiveContents>> ArchiveContents::archive_by_name;
 std::unordered_map<uint64_t, ArchiveContentsPtr> ArchiveContents::archive_by_id;
+std::set<uint64_t> ArchiveContents::detector_worklist;
 
 ArchiveContents::ArchiveContents(ArchiveType type_, std::string name_, filetype_t filetype_, where_t where_, int flags_, std::string filename_extension_) :
     id(0),
@@ -74,7 +121,8 @@ ArchiveContents::ArchiveContents(ArchiveType type_, std::string name_, filetype_
     mtime(0),
     size(0),
     archive_type(type_),
-    filename_extension(std::move(filename_extension_)) { }
+    filename_extension(std::move(filename_extension_)),
+    file_indices_valid(false) { }
 
 Archive::Archive(ArchiveContentsPtr contents_) :
     contents(std::move(contents_)),
@@ -93,6 +141,7 @@ ArchivePtr Archive::open(const ArchiveContentsPtr& contents) {
     ArchivePtr archive;
     
     if (contents->open_archive.expired()) {
+        reuse_misses += 1;
         switch (contents->archive_type) {
             case ARCHIVE_LIBARCHIVE:
 #ifdef HAVE_LIBARCHIVE
@@ -123,12 +172,74 @@ ArchivePtr Archive::open(const ArchiveContentsPtr& contents) {
     }
     else {
         //printf("# already open %s\n", archive->name.c_str());
+        reuse_hits += 1;
         archive = contents->open_archive.lock();
     }
-    
+
+    mark_used(archive);
     return archive;
 }
 
+
+/* Close archive kept open for reuse, which commits its pending changes. */
+static void close_kept_archive(Archive *archive) {
+    try {
+        if (!archive->close()) {
+            output.error("%s: can't close archive, changes may be lost", archive->name.c_str());
+        }
+    }
+    catch (Exception &e) {
+        output.error("%s: can't close archive: %s", archive->name.c_str(), e.what());
+    }
+}
+
+
+/* Keep archive open for reuse; close least recently used archives that are no longer referenced elsewhere to stay within max_open_archives. */
+void Archive::mark_used(const ArchivePtr &archive) {
+    if (max_open_archives == 0 || !IS_EXTERNAL(archive->where) || (archive->contents->flags & ARCHIVE_FL_NOCACHE)) {
+        return;
+    }
+
+    auto it = recently_used_index.find(archive.get());
+    if (it != recently_used_index.end()) {
+        recently_used.splice(recently_used.begin(), recently_used, it->second);
+        return;
+    }
+
+    recently_used.push_front(archive);
+    recently_used_index[archive.get()] = recently_used.begin();
+
+    auto victim = recently_used.end();
+    while (recently_used.size() > max_open_archives && victim != recently_used.begin()) {
+        --victim;
+        if (victim->use_count() > 1) {
+            /* still in use */
+            continue;
+        }
+        close_kept_archive(victim->get());
+        recently_used_index.erase(victim->get());
+        victim = recently_used.erase(victim);
+    }
+}
+
+
+void Archive::close_unused_archives() {
+    for (auto &archive : recently_used) {
+        close_kept_archive(archive.get());
+    }
+    recently_used_index.clear();
+    recently_used.clear();
+
+    if (reuse_hits > 0) {
+        performance.add("archive reopens avoided", reuse_hits, {});
+    }
+    if (reuse_misses > 0) {
+        performance.add("archive reopens", reuse_misses, {});
+    }
+    reuse_hits = 0;
+    reuse_misses = 0;
+}
+
 ArchivePtr Archive::by_id(uint64_t id) {
     auto contents = ArchiveContents::by_id(id);
     
@@ -140,13 +251,12 @@ ArchivePtr Archive::by_id(uint64_t id) {
 }
 
 
-int Archive::close() {
-    int ret;
+bool Archive::close() {
     output.set_error_archive(name);
 
-    ret = commit();
+    auto ok = commit();
 
-    return close_xxx() | ret;
+    return close_xxx() && ok;
 }
 
 
@@ -160,6 +270,7 @@ void Archive::ensure_valid_archive() {
     auto new_name = ::make_unique_name(name, ".broken");
     
     output.message_verbose("rename broken archive '%s' to '%s'", name.c_str(), new_name.c_str());
+    CkmameCache::archive_changed(name);
     if (!rename_or_move(name, new_name)) {
         throw(Exception("can't rename file")); // TODO: rename_or_move should throw
     }
@@ -169,6 +280,20 @@ void Archive::ensure_valid_archive() {
 }
 
 
+/* Compute hashes of file if they were deferred when the archive was opened. */
+bool Archive::file_ensure_crc(uint64_t index) {
+    if (!want_crc() || files[index].hashes.has_type(Hashes::TYPE_CRC)) {
+        return true;
+    }
+
+    auto ok = file_ensure_hashes(index, Hashes::TYPE_ALL);
+    if (is_indexed()) {
+        memdb->update_file(contents.get(), index);
+    }
+    return ok;
+}
+
+
 int Archive::file_compare_hashes(uint64_t index, const Hashes *hashes) {
     auto &file_hashes = files[index].hashes;
 
@@ -197,6 +322,8 @@ bool Archive::file_ensure_hashes(uint64_t idx, size_t detector_id, int hashtypes
 	Hashes hashes;
 	hashes.add_types(Hashes::TYPE_ALL);
 
+	/* run detectors on the data while it is read anyway */
+	auto detector_execution = missing_detectors_execution(idx);
 
         ZipSourcePtr f;
 
@@ -209,7 +336,7 @@ bool Archive::file_ensure_hashes(uint64_t idx, size_t detector_id, int hashtypes
 	    return false;
 	}
 
-	switch (get_hashes(f.get(), file.hashes.size, true, &hashes)) {
+	switch (get_hashes(f.get(), file.hashes.size, true, &hashes, detector_execution.get())) {
 	case OK:
 	    break;
 
@@ -225,6 +352,14 @@ bool Archive::file_ensure_hashes(uint64_t idx, size_t detector_id, int hashtypes
 	}
 
 	file.hashes.set_hashes(hashes);
+	file.data_verified = true;
+	if (detector_execution) {
+	    detector_execution->end(&file);
+	    /* before the archive is entered in maps, memdb gets all hashes from there; with deferred hashes, that happens in finish_deferred_hashes() */
+	    if (contents->id != 0 && is_indexed() && !(contents->flags & ARCHIVE_FL_DEFER_HASHES)) {
+		memdb->update_file(contents.get(), idx);
+	    }
+	}
     }
     else {
 	if (!compute_detector_hashes(idx, db->detectors)) {
@@ -237,10 +372,68 @@ bool Archive::file_ensure_hashes(uint64_t idx, size_t detector_id, int hashtypes
 }
 
 
+/* Store hashes computed by file_compute_hashes() for the files in deferred_hashes (in the same order) and enter archive into memdb. */
+void Archive::finish_deferred_hashes(const std::vector<std::optional<Hashes>> &hashes) {
+    for (size_t i = 0; i < deferred_hashes.size(); i++) {
+        auto index = deferred_hashes[i];
+
+        if (i < hashes.size() && hashes[i].has_value()) {
+            files[index].hashes.set_hashes(hashes[i].value());
+            files[index].data_verified = true;
+            cache_changed = true;
+        }
+        else {
+            /* computing them again reports the error and marks the file as broken */
+            file_ensure_hashes(index, Hashes::TYPE_ALL);
+            cache_changed = true;
+        }
+    }
+    deferred_hashes.clear();
+
+    if (contents->flags & ARCHIVE_FL_DEFER_HASHES) {
+        contents->flags &= ~ARCHIVE_FL_DEFER_HASHES;
+        if (is_indexed()) {
+            memdb->insert_archive(contents.get());
+            ArchiveContents::add_to_detector_worklist(contents->id);
+        }
+    }
+}
+
+
+// Doesn't report errors or modify the archive, so it can be run in a worker thread while nothing else accesses this archive.
+std::optional<Hashes> Archive::file_compute_hashes(uint64_t index) {
+    auto &file = files[index];
+
+    if (file.broken) {
+        return {};
+    }
+
+    Hashes hashes;
+    hashes.add_types(Hashes::TYPE_ALL);
+
+    try {
+        auto source = get_source(index);
+        source->open();
+
+        if (get_hashes(source.get(), file.hashes.size, true, &hashes) != OK) {
+            return {};
+        }
+    }
+    catch (...) {
+        return {};
+    }
+
+    return hashes;
+}
+
+
+/* Search file index for a part matching hashes, returns offset of first match, which is a multiple of size.
+   If hashes include a CRC, only CRCs of parts are computed while reading; the other hashes are checked only for parts with matching CRC. */
 std::optional<size_t> Archive::file_find_offset(size_t index, size_t size, const Hashes *hashes) {
+    auto crc_only = hashes->has_type(Hashes::TYPE_CRC) && hashes->get_types() != Hashes::TYPE_CRC;
     Hashes hashes_part;
 
-    hashes_part.add_types(hashes->get_types());
+    hashes_part.add_types(crc_only ? static_cast<int>(Hashes::TYPE_CRC) : hashes->get_types());
 
     auto &file = files[index];
 
@@ -249,7 +442,6 @@ std::optional<size_t> Archive::file_find_offset(size_t index, size_t size, const
 
         source->open();
         
-        auto found = false;
         size_t offset = 0;
         while (offset + size <= file.hashes.size) {
             if (get_hashes(source.get(), size, offset + size == file.hashes.size, &hashes_part) != OK) {
@@ -258,16 +450,25 @@ std::optional<size_t> Archive::file_find_offset(size_t index, size_t size, const
             }
 
             if (hashes->compare(hashes_part) == Hashes::MATCH) {
-                found = true;
-                break;
+                if (!crc_only) {
+                    return offset;
+                }
+
+                Hashes hashes_full;
+                hashes_full.add_types(hashes->get_types());
+                auto part_source = get_source(index, offset, size);
+                part_source->open();
+                if (get_hashes(part_source.get(), size, true, &hashes_full) != OK) {
+                    file.broken = true;
+                    return {};
+                }
+                if (hashes->compare(hashes_full) == Hashes::MATCH) {
+                    return offset;
+                }
             }
 
             offset += size;
         }
-
-        if (found) {
-            return offset;
-        }
     }
     catch (Exception &e) {
         file.broken = true;
@@ -377,6 +578,7 @@ ArchivePtr Archive::open(const std::string &name, filetype_t filetype, where_t w
     }
     
     ArchiveContents::enter_in_maps(archive->contents);
+    mark_used(archive);
 
     return archive;
 }
@@ -413,6 +615,7 @@ bool Archive::read_infos() {
                 // For directories, mtime doesn't change for all changes of files within that directory, so we always have to rescan.
                 if (contents->size != 0) {
                     files = files_cache;
+                    contents->files_changed();
                     changes.resize(files.size());
                     return true;
                 }
@@ -420,7 +623,9 @@ bool Archive::read_infos() {
 	    }
     }
 
-    if (!read_infos_xxx()) {
+    auto ok = read_infos_xxx();
+    contents->files_changed();
+    if (!ok) {
         cache_changed = true;
 	return false;
     }
@@ -464,12 +669,26 @@ int ArchiveContents::is_cache_up_to_date() const {
 }
 
 
-Archive::GetHashesStatus Archive::get_hashes(ZipSource *source, uint64_t length, bool eof, Hashes *hashes) {
+Archive::GetHashesStatus Archive::get_hashes(ZipSource *source, uint64_t length, bool eof, Hashes *hashes, Detector::Execution *detector_execution) {
     unsigned char buf[BUFSIZE];
 
     try {
         auto hu = Hashes::Update(hashes);
 
+        /* if all reader threads are busy or one can't be started, read in this thread */
+        if (hash_thread_threshold > 0 && length > hash_thread_threshold) {
+            auto slot = HashReaderThreadSlot();
+            if (slot.acquired) {
+                auto status = get_hashes_pipelined(source, length, &hu, detector_execution);
+                if (status.has_value()) {
+                    if (status.value() != OK) {
+                        return status.value();
+                    }
+                    length = 0;
+                }
+            }
+        }
+
         while (length > 0) {
             uint64_t n = std::min(length, static_cast<uint64_t>(sizeof(buf)));
             if (source->read(buf, n) != n) {
@@ -477,6 +696,9 @@ Archive::GetHashesStatus Archive::get_hashes(ZipSource *source, uint64_t length,
             }
 
             hu.update(buf, n);
+            if (detector_execution) {
+                detector_execution->update(buf, n);
+            }
             length -= n;
         }
 
@@ -499,16 +721,107 @@ Archive::GetHashesStatus Archive::get_hashes(ZipSource *source, uint64_t length,
 }
 
 
+/* Read length bytes from source in a separate thread, handing blocks to the calling thread for hashing.
+   Returns nothing if the thread can't be started; nothing was read from source then. */
+std::optional<Archive::GetHashesStatus> Archive::get_hashes_pipelined(ZipSource *source, uint64_t length, Hashes::Update *hu, Detector::Execution *detector_execution) {
+    /* allocated once per hashing thread; the reader thread uses the buffers of the thread it was started by */
+    static thread_local std::vector<std::vector<uint8_t>> thread_buffers;
+    if (thread_buffers.empty()) {
+        thread_buffers.assign(HASH_PIPELINE_BUFFERS, std::vector<uint8_t>(HASH_PIPELINE_BLOCK_SIZE));
+    }
+    auto &buffers = thread_buffers;
+    std::vector<size_t> buffer_lengths(HASH_PIPELINE_BUFFERS);
+    std::mutex mutex;
+    std::condition_variable changed;
+    uint64_t blocks_read = 0;
+    uint64_t blocks_hashed = 0;
+    auto read_error = false;
+
+    std::thread reader;
+    try {
+        reader = std::thread([&]() {
+            auto remaining = length;
+            try {
+                while (remaining > 0) {
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        changed.wait(lock, [&] { return blocks_read - blocks_hashed < HASH_PIPELINE_BUFFERS; });
+                    }
+
+                    auto index = blocks_read % HASH_PIPELINE_BUFFERS;
+                    auto n = static_cast<size_t>(std::min(remaining, static_cast<uint64_t>(HASH_PIPELINE_BLOCK_SIZE)));
+                    if (source->read(buffers[index].data(), n) != n) {
+                        throw Exception();
+                    }
+                    remaining -= n;
+
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        buffer_lengths[index] = n;
+                        blocks_read += 1;
+                    }
+                    changed.notify_one();
+                }
+            }
+            catch (...) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    read_error = true;
+                }
+                changed.notify_one();
+            }
+        });
+    }
+    catch (std::system_error &e) {
+        return {};
+    }
+
+    uint64_t hashed = 0;
+    while (hashed < length) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return blocks_read > blocks_hashed || read_error; });
+            if (read_error) {
+                break;
+            }
+        }
+
+        auto index = blocks_hashed % HASH_PIPELINE_BUFFERS;
+        hu->update(buffers[index].data(), buffer_lengths[index]);
+        if (detector_execution) {
+            detector_execution->update(buffers[index].data(), buffer_lengths[index]);
+        }
+        hashed += buffer_lengths[index];
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            blocks_hashed += 1;
+        }
+        changed.notify_one();
+    }
+
+    reader.join();
+
+    return read_error ? READ_ERROR : OK;
+}
+
+
 void Archive::merge_files(const std::vector<File> &files_cache) {
+    std::unordered_map<std::string, const File *> cached_by_name;
+    for (const auto &file_cache : files_cache) {
+        cached_by_name.emplace(file_cache.name, &file_cache);
+    }
+
     for (uint64_t i = 0; i < files.size(); i++) {
         auto &file = files[i];
         
         file.filename_extension = contents->filename_extension;
-        auto it = std::find_if(files_cache.cbegin(), files_cache.cend(), [&file](const File &file_cache){ return file.name == file_cache.name; });
-        if (it != files_cache.cend()) {
-            if (file.mtime == (*it).mtime && file.compare_size_hashes(*it)) {
-                file.hashes.merge((*it).hashes);
-                file.detector_hashes = it->detector_hashes;
+        auto it = cached_by_name.find(file.name);
+        const File *cached = it != cached_by_name.end() ? it->second : nullptr;
+        if (cached != nullptr) {
+            if (file.mtime == cached->mtime && file.compare_size_hashes(*cached)) {
+                file.hashes.merge(cached->hashes);
+                file.detector_hashes = cached->detector_hashes;
             }
             else {
                 cache_changed = true;
@@ -518,10 +831,15 @@ void Archive::merge_files(const std::vector<File> &files_cache) {
             cache_changed = true;
         }
         
-        if (want_crc() && !file.hashes.has_type(Hashes::TYPE_CRC)) {
+        /* With hash_extra_on_demand, files in extra directories are only hashed once a ROM of the same size is searched for. */
+        if (want_crc() && !(where == FILE_EXTRA && configuration.hash_extra_on_demand) && !file.hashes.has_type(Hashes::TYPE_CRC)) {
+            if (contents->flags & ARCHIVE_FL_DEFER_HASHES) {
+                deferred_hashes.push_back(i);
+                continue;
+            }
             if (!file_ensure_hashes(i, Hashes::TYPE_ALL)) {
                 file.broken = true;
-                if (it == files_cache.cend() || !(*it).broken) {
+                if (cached == nullptr || !cached->broken) {
                     cache_changed = true;
                 }
                 continue;
@@ -536,7 +854,7 @@ void Archive::merge_files(const std::vector<File> &files_cache) {
 }
 
 std::optional<size_t> Archive::file_index(const FileData *file) const {
-    for (size_t index = 0; index < files.size(); index++) {
+    for (auto index : contents->file_indices_by_name(file->name)) {
         if (&files[index] == file) {
             return index;
         }
@@ -575,8 +893,10 @@ void ArchiveContents::enter_in_maps(const ArchiveContentsPtr &contents) {
         contents->id = ++next_id;
         archive_by_id[contents->id] = contents;
         
-        if (IS_EXTERNAL(contents->where)) {
+        /* with deferred hashes, this is done in finish_deferred_hashes() */
+        if (IS_EXTERNAL(contents->where) && !(contents->flags & ARCHIVE_FL_DEFER_HASHES)) {
             memdb->insert_archive(contents.get());
+            add_to_detector_worklist(contents->id);
         }
     }
 
@@ -607,20 +927,160 @@ ArchiveContentsPtr ArchiveContents::by_name(filetype_t filetype, const std::stri
 void ArchiveContents::clear_cache() {
     archive_by_name.clear();
     archive_by_id.clear();
+    detector_worklist.clear();
     next_id = 0;
 }
 
 
+/* Record that indexed archive id may lack detector hashes, they are computed by compute_pending_detector_hashes(). */
+void ArchiveContents::add_to_detector_worklist(uint64_t id) {
+    if (db && !db->detectors.empty()) {
+        detector_worklist.insert(id);
+    }
+}
+
+
+/* Compute missing detector hashes of archives in worklist (only those in needed if needed_only), returns true if new hashes were computed. */
+bool ArchiveContents::compute_pending_detector_hashes(bool needed_only) {
+    if (detector_worklist.empty()) {
+        return false;
+    }
+
+    auto measurement = Performance::Measurement(&performance, "compute detector hashes");
+    auto got_new_hashes = false;
+
+    for (auto it = detector_worklist.begin(); it != detector_worklist.end();) {
+        auto contents = by_id(*it);
+
+        if (contents && needed_only && contents->where != FILE_NEEDED) {
+            it++;
+            continue;
+        }
+        it = detector_worklist.erase(it);
+
+        if (!contents || contents->has_all_detector_hashes(db->detectors)) {
+            continue;
+        }
+        auto archive = Archive::open(contents);
+        if (!archive) {
+            continue;
+        }
+        measurement.add(1);
+        if (archive->compute_detector_hashes(db->detectors)) {
+            got_new_hashes = true;
+        }
+    }
+
+    return got_new_hashes;
+}
+
+
 std::optional<size_t> ArchiveContents::file_index_by_name(const std::string &filename) const {
+    auto &indices = file_indices_by_name(filename);
+
+    if (indices.empty()) {
+        return {};
+    }
+
+    return indices.front();
+}
+
+
+/* Returns indices of files named filename, in increasing order. */
+const std::vector<size_t> &ArchiveContents::file_indices_by_name(const std::string &filename) const {
+    static const std::vector<size_t> none;
+
+    ensure_file_indices();
+
+    auto it = files_by_name.find(filename);
+    if (it == files_by_name.end()) {
+        return none;
+    }
+
+    return it->second;
+}
+
+
+/* Returns indices of files that can match size and CRC of wanted, in increasing order. Files whose size or CRC isn't known are included. */
+std::vector<size_t> ArchiveContents::file_indices_by_size_crc(const FileData &wanted) const {
+    ensure_file_indices();
+
+    auto by_size = wanted.is_size_known();
+    auto by_crc = wanted.hashes.has_type(Hashes::TYPE_CRC);
+    const std::vector<size_t> *known = nullptr;
+    const std::vector<size_t> *unknown = nullptr;
+
+    /* use the index with fewer candidates, check the other condition on the files */
+    if (by_size) {
+        auto it = files_by_size.find(wanted.hashes.size);
+        known = it == files_by_size.end() ? nullptr : &it->second;
+        unknown = &files_without_size;
+    }
+    if (by_crc) {
+        auto it = files_by_crc.find(wanted.hashes.crc);
+        auto crc_known = it == files_by_crc.end() ? nullptr : &it->second;
+        auto crc_count = (crc_known ? crc_known->size() : 0) + files_without_crc.size();
+        if (!by_size || crc_count < (known ? known->size() : 0) + unknown->size()) {
+            known = crc_known;
+            unknown = &files_without_crc;
+        }
+    }
+
+    std::vector<size_t> indices;
+
+    if (unknown == nullptr) {
+        indices.resize(files.size());
+        for (size_t i = 0; i < files.size(); i++) {
+            indices[i] = i;
+        }
+        return indices;
+    }
+
+    if (known) {
+        indices = *known;
+    }
+    indices.insert(indices.end(), unknown->begin(), unknown->end());
+    std::sort(indices.begin(), indices.end());
+
+    indices.erase(std::remove_if(indices.begin(), indices.end(), [&](size_t index) {
+        auto &file = files[index].hashes;
+        return (by_size && file.size != Hashes::SIZE_UNKNOWN && file.size != wanted.hashes.size) || (by_crc && file.has_type(Hashes::TYPE_CRC) && file.crc != wanted.hashes.crc);
+    }), indices.end());
+
+    return indices;
+}
+
+
+void ArchiveContents::ensure_file_indices() const {
+    if (file_indices_valid) {
+        return;
+    }
+
+    files_by_name.clear();
+    files_by_size.clear();
+    files_by_crc.clear();
+    files_without_size.clear();
+    files_without_crc.clear();
+
     for (size_t i = 0; i < files.size(); i++) {
         auto &file = files[i];
-        
-        if (filename == file.name) {
-            return i;
+
+        files_by_name[file.name].push_back(i);
+        if (file.is_size_known(0)) {
+            files_by_size[file.hashes.size].push_back(i);
+        }
+        else {
+            files_without_size.push_back(i);
+        }
+        if (file.hashes.has_type(Hashes::TYPE_CRC)) {
+            files_by_crc[file.hashes.crc].push_back(i);
+        }
+        else {
+            files_without_crc.push_back(i);
         }
     }
 
-    return {};
+    file_indices_valid = true;
 }
 
 bool Archive::compute_detector_hashes(const std::unordered_map<size_t, DetectorPtr> &detectors) {
@@ -659,7 +1119,12 @@ bool Archive::compute_detector_hashes(size_t index, const std::unordered_map<siz
         return false;
     }
     
-    auto data = std::vector<uint8_t>(file.get_size(0));
+    if (file.get_size(0) > Detector::MAX_DETECTOR_FILE_SIZE) {
+        return false;
+    }
+
+    auto detector_execution = Detector::Execution(detectors, file.get_size(0));
+    Hashes hashes; // no hash types, only detectors are run
 
     try {
         auto source = get_source(index);
@@ -667,7 +1132,9 @@ bool Archive::compute_detector_hashes(size_t index, const std::unordered_map<siz
             throw Exception("can't open: %s", strerror(errno));
         }
         source->open();
-        source->read(data.data(), data.size());
+        if (get_hashes(source.get(), file.get_size(0), false, &hashes, &detector_execution) != OK) {
+            throw Exception("read error");
+        }
     }
     catch (std::exception &e) {
         output.error("%s: %s: can't compute hashes: %s", name.c_str(), file.name.c_str(), e.what());
@@ -676,11 +1143,31 @@ bool Archive::compute_detector_hashes(size_t index, const std::unordered_map<siz
         return false;
     }
 
-    auto ok = Detector::compute_hashes(data, &file, detectors);
-    if (ok) {
-	memdb->update_file(contents.get(), index);
+    detector_execution.end(&file);
+    memdb->update_file(contents.get(), index);
+    return true;
+}
+
+
+/* Returns execution of the ROM database's detectors that haven't been run on file index yet, or nullptr if there are none. */
+std::unique_ptr<Detector::Execution> Archive::missing_detectors_execution(size_t index) {
+    auto &file = files[index];
+
+    if (!db || db->detectors.empty() || file.get_size(0) > Detector::MAX_DETECTOR_FILE_SIZE) {
+        return nullptr;
+    }
+
+    std::unordered_map<size_t, DetectorPtr> missing_detectors;
+    for (const auto &pair : db->detectors) {
+        if (file.detector_hashes.find(pair.first) == file.detector_hashes.end()) {
+            missing_detectors[pair.first] = pair.second;
+        }
     }
-    return ok;
+    if (missing_detectors.empty()) {
+        return nullptr;
+    }
+
+    return std::make_unique<Detector::Execution>(missing_detectors, file.get_size(0));
 }
 
 
@@ -721,3 +1208,4 @@ bool Archive::compare_size_hashes(size_t index, size_t detector_id, const FileDa
     
     return ok;
 }
+
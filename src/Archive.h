@@ -34,8 +34,10 @@
   IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <list>
 #include <memory>
 #include <optional>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -59,6 +61,7 @@ typedef std::shared_ptr<ArchiveContents> ArchiveContentsPtr;
 #define ARCHIVE_FL_NOCACHE 0x00800
 #define ARCHIVE_FL_RDONLY 0x01000
 #define ARCHIVE_FL_TOP_LEVEL_ONLY 0x02000
+#define ARCHIVE_FL_DEFER_HASHES 0x04000 /* don't compute missing hashes when opening, see finish_deferred_hashes() */
 
 #define ARCHIVE_FL_HASHTYPES_MASK 0x000ff
 #define ARCHIVE_FL_MASK 0x0ff00
@@ -92,6 +95,9 @@ public:
     std::string filename_extension;
   
     [[nodiscard]] std::optional<size_t> file_index_by_name(const std::string &name) const;
+    [[nodiscard]] const std::vector<size_t> &file_indices_by_name(const std::string &name) const;
+    [[nodiscard]] std::vector<size_t> file_indices_by_size_crc(const FileData &wanted) const;
+    void files_changed() { file_indices_valid = false; } // call after adding, removing, or renaming files
     bool has_all_detector_hashes(const std::unordered_map<size_t, DetectorPtr> &detectors);
     
     bool read_infos_from_cachedb(std::vector<File> *cached_files);
@@ -101,6 +107,9 @@ public:
     static ArchiveContentsPtr by_id(uint64_t id);
     static ArchiveContentsPtr by_name(filetype_t filetype, const std::string &name);
     static void clear_cache();
+    static void add_to_detector_worklist(uint64_t id);
+    static bool compute_pending_detector_hashes(bool needed_only);
+    static uint64_t last_id() { return next_id; } // archives entered in maps later have larger ids
 
     class TypeAndName {
     public:
@@ -113,9 +122,21 @@ public:
     };
     
 private:
+    /* indices of files by name, size, and CRC, built on first lookup; files whose size or CRC wasn't known then are listed separately */
+    mutable std::unordered_map<std::string, std::vector<size_t>> files_by_name;
+    mutable std::unordered_map<uint64_t, std::vector<size_t>> files_by_size;
+    mutable std::unordered_map<uint32_t, std::vector<size_t>> files_by_crc;
+    mutable std::vector<size_t> files_without_size;
+    mutable std::vector<size_t> files_without_crc;
+    mutable bool file_indices_valid;
+
+    void ensure_file_indices() const;
+
     static uint64_t next_id;
     static std::unordered_map<TypeAndName, std::weak_ptr<ArchiveContents>> archive_by_name;
     static std::unordered_map<uint64_t, ArchiveContentsPtr> archive_by_id;
+    /* ids of indexed archives that may lack detector hashes */
+    static std::set<uint64_t> detector_worklist;
 
 };
 
@@ -153,13 +174,16 @@ public:
     static ArchivePtr open_toplevel(const std::string &name, filetype_t filetype, where_t where, int flags);
     
     static ArchivePtr open(const ArchiveContentsPtr& contents);
+    static void close_unused_archives();
 
     static bool read_only_mode;
+    static size_t hash_thread_threshold; // files larger than this are read in a separate thread while hashing
+    static size_t max_open_archives; // number of recently used external archives kept open for reuse
 
     explicit Archive(ArchiveContentsPtr contents_);
     virtual ~Archive() = default;
 
-    int close();
+    bool close();
     bool commit();
     bool compare_size_hashes(size_t index, size_t detector_id, const FileData *rom);
     bool compute_detector_hashes(const std::unordered_map<size_t, DetectorPtr> &detectors);
@@ -168,6 +192,9 @@ public:
     int file_compare_hashes(uint64_t idx, const Hashes *h);
     virtual bool file_ensure_hashes(uint64_t idx, int hashtypes) { return file_ensure_hashes(idx, 0, hashtypes); }
     bool file_ensure_hashes(uint64_t index, size_t detector_id, int hashtypes);
+    bool file_ensure_crc(uint64_t index);
+    std::optional<Hashes> file_compute_hashes(uint64_t index);
+    void finish_deferred_hashes(const std::vector<std::optional<Hashes>> &hashes);
     bool file_copy(Archive *source_archive, uint64_t source_index, const std::string &filename);
     bool file_copy_or_move(Archive *source_archive, uint64_t source_index, const std::string &filename, bool copy);
     bool file_copy_part(Archive *source_archive, uint64_t source_index, const std::string &filename, uint64_t start, std::optional<uint64_t> length, const Hashes *hashes);
@@ -193,6 +220,8 @@ public:
     virtual bool read_infos_xxx() = 0;
     [[nodiscard]] virtual bool want_crc() const { return true; }
     [[nodiscard]] virtual bool have_direct_file_access() const { return false; }
+    [[nodiscard]] virtual bool accepts_compressed_sources() const { return false; } // whether compressed data from get_compressed_source() can be added without recompressing
+    virtual ZipSourcePtr get_compressed_source(uint64_t index) { return get_source(index); }
     ZipSourcePtr get_source(uint64_t index) { return get_source(index, 0, {}); }
     virtual ZipSourcePtr get_source(uint64_t index, uint64_t start, std::optional<uint64_t> length) = 0;
     virtual std::string get_full_filename(uint64_t index) { return ""; }
@@ -204,6 +233,7 @@ public:
     const filetype_t filetype;
     const where_t where;
     std::vector<Change> changes;
+    std::vector<uint64_t> deferred_hashes; // files whose hashes weren't computed because of ARCHIVE_FL_DEFER_HASHES
 
     bool cache_changed;
     bool modified;
@@ -218,11 +248,21 @@ protected:
     void update_cache();
 
     void add_file(const std::string &filename, const Hashes *hashes, const std::unordered_map<size_t, Hashes> *detector_hashes);
-    GetHashesStatus get_hashes(ZipSource *source, uint64_t length, bool eof, Hashes *hashes);
+    GetHashesStatus get_hashes(ZipSource *source, uint64_t length, bool eof, Hashes *hashes, Detector::Execution *detector_execution = nullptr);
     void merge_files(const std::vector<File> &files_cache);
     
 private:
+    /* external archives kept open for reuse, most recently used first */
+    static std::list<ArchivePtr> recently_used;
+    static std::unordered_map<const Archive *, std::list<ArchivePtr>::iterator> recently_used_index;
+    static uint64_t reuse_hits;
+    static uint64_t reuse_misses;
+
+    static void mark_used(const ArchivePtr &archive);
+
+    std::optional<GetHashesStatus> get_hashes_pipelined(ZipSource *source, uint64_t length, Hashes::Update *hu, Detector::Execution *detector_execution);
     bool compute_detector_hashes(size_t index, const std::unordered_map<size_t, DetectorPtr> &detectors);
+    std::unique_ptr<Detector::Execution> missing_detectors_execution(size_t index);
 };
 
 #endif //* HAD_ARCHIVE_H
@@ -299,6 +299,34 @@ bool ArchiveZip::read_infos_xxx() {
 }
 
 
+/* Torrentzipped archives need their files compressed with specific parameters. */
+bool ArchiveZip::accepts_compressed_sources() const {
+    return !(where == FILE_ROMSET && configuration.use_torrentzip);
+}
+
+
+/* Source of the file's compressed data, which libzip copies into the destination archive without decompressing and recompressing it, and without checking its CRC.
+   Only stored and deflated data is copied, other compression methods are decompressed and written deflated. */
+ZipSourcePtr ArchiveZip::get_compressed_source(uint64_t index) {
+    if (!ensure_zip()) {
+        throw Exception();
+    }
+
+    zip_stat_t st;
+    if (zip_stat_index(za, index, ZIP_FL_UNCHANGED, &st) < 0 || (st.valid & ZIP_STAT_COMP_METHOD) == 0 || (st.comp_method != ZIP_CM_STORE && st.comp_method != ZIP_CM_DEFLATE)) {
+        return get_source(index, 0, {});
+    }
+
+    auto source = zip_source_zip_file_create(za, index, ZIP_FL_UNCHANGED | ZIP_FL_COMPRESSED, 0, -1, nullptr, nullptr);
+
+    if (source == nullptr) {
+        throw Exception("%s", zip_strerror(za));
+    }
+
+    return std::make_shared<ZipSource>(source);
+}
+
+
 ZipSourcePtr ArchiveZip::get_source(uint64_t index, uint64_t start, std::optional<uint64_t> length_) {
     if (!ensure_zip()) {
         throw Exception();
@@ -47,6 +47,7 @@ public:
 
     ~ArchiveZip() override;
 
+    [[nodiscard]] bool accepts_compressed_sources() const override;
     bool check() override;
     bool close_xxx() override;
     bool commit_xxx() override;
@@ -57,6 +58,7 @@ public:
 protected:
     zip_t *za;
     
+    ZipSourcePtr get_compressed_source(uint64_t index) override;
     ZipSourcePtr get_source(uint64_t index, uint64_t start, std::optional<uint64_t> length) override;
     bool ensure_zip();
     
@@ -43,6 +43,7 @@ class CkMame : public Command {
     void global_setup(const ParsedCommandline &commandline) override;
     bool execute(const std::vector<std::string> &arguments) override;
     bool cleanup() override;
+    [[nodiscard]] bool updates_dat_directories() const override;
 
   private:
     std::string game_list;
@@ -35,23 +35,51 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <algorithm>
 #include <filesystem>
+#include <set>
 
 #include "globals.h"
 #include "util.h"
 #include "Exception.h"
 #include "Dir.h"
+#include "Performance.h"
+#include "RomDB.h"
 #include "sighandle.h"
+#include "WorkerPool.h"
+
+// number of archives opened per worker thread in one batch
+#define SCAN_BATCH_SIZE_PER_JOB 4
 
 CkmameCachePtr ckmame_cache;
+std::unordered_map<std::string, CkmameCache::DirectoryScan> CkmameCache::directory_scans;
 
 CkmameCache::CkmameCache() :
     extra_delete_list(std::make_shared<DeleteList>()),
     needed_delete_list(std::make_shared<DeleteList>()),
     superfluous_delete_list(std::make_shared<DeleteList>()),
     extra_map_done(false),
-    needed_map_done(false) {
+    needed_map_done(false),
+    directory_lookups(0),
+    extra_index_lookups(0) {
 }
 
+CkmameCache::~CkmameCache() {
+    /* Kept archives must not hold on to our databases. */
+    for (auto &pair : directory_scans) {
+	for (auto &entry : pair.second.archives) {
+	    entry.contents->cache_db = nullptr;
+	}
+    }
+    close_all();
+
+    if (directory_lookups > 0) {
+	performance.add("cache directory lookups", directory_lookups, {});
+    }
+    if (extra_index_lookups > 0) {
+	performance.add("extra directory index lookups", extra_index_lookups, {});
+    }
+}
+
+
 bool CkmameCache::close_all() {
     auto ok = true;
 
@@ -77,6 +105,21 @@ bool CkmameCache::close_all() {
 }
 
 
+/* Commit pending writes to cache databases; if only_due, only of those whose transaction has been open too long. */
+void CkmameCache::flush_databases(bool only_due) {
+    for (auto &directory : cache_directories) {
+	if (directory.db) {
+	    if (only_due) {
+		directory.db->flush_if_due();
+	    }
+	    else {
+		directory.db->flush();
+	    }
+	}
+    }
+}
+
+
 CkmameDBPtr CkmameCache::get_db_for_archive(const std::string &name) {
     auto directory = get_directory_for_archive(name);
 
@@ -95,34 +138,54 @@ std::string CkmameCache::get_directory_name_for_archive(const std::string &name)
     return "";
 }
 
+/* Returns the cache directory containing name. Cache directories aren't nested, so at most one of the leading path components of name matches. */
+CkmameCache::CacheDirectory *CkmameCache::find_directory(std::string_view name) {
+    size_t position = 0;
+
+    while (true) {
+	auto end = name.find('/', position);
+	auto it = cache_directory_index.find(name.substr(0, end));
+	if (it != cache_directory_index.end()) {
+	    return &cache_directories[it->second];
+	}
+	if (end == std::string::npos) {
+	    return nullptr;
+	}
+	position = end + 1;
+    }
+}
+
+
 const CkmameCache::CacheDirectory* CkmameCache::get_directory_for_archive(const std::string &name) {
-    for (auto &directory : cache_directories) {
-	if (name.compare(0, directory.name.length(), directory.name) == 0 && (name.length() == directory.name.length() || name[directory.name.length()] == '/')) {
-	    if (!directory.initialized) {
-		directory.initialized = true;
-		if (!configuration.fix_romset) {
-		    std::error_code ec;
-		    if (!std::filesystem::exists(directory.name, ec)) {
-			return nullptr; /* we won't write any files, so DB would remain empty */
-		    }
-		}
-		if (!ensure_dir(directory.name, false)) {
-		    return nullptr;
-		}
+    directory_lookups += 1;
 
-		try {
-		    directory.db = std::make_shared<CkmameDB>(directory.name);
-		}
-		catch (std::exception &e) {
-		    output.error_database("can't open rom directory database for '%s': %s", directory.name.c_str(), e.what());
-		    return nullptr;
-		}
+    auto directory = find_directory(name);
+    if (directory == nullptr) {
+	return nullptr;
+    }
+
+    if (!directory->initialized) {
+	directory->initialized = true;
+	if (!configuration.fix_romset) {
+	    std::error_code ec;
+	    if (!std::filesystem::exists(directory->name, ec)) {
+		return nullptr; /* we won't write any files, so DB would remain empty */
 	    }
-	    return &directory;
+	}
+	if (!ensure_dir(directory->name, false)) {
+	    return nullptr;
+	}
+
+	try {
+	    directory->db = std::make_shared<CkmameDB>(directory->name);
+	}
+	catch (std::exception &e) {
+	    output.error_database("can't open rom directory database for '%s': %s", directory->name.c_str(), e.what());
+	    return nullptr;
 	}
     }
 
-    return nullptr;
+    return directory;
 }
 
 
@@ -142,18 +205,23 @@ void CkmameCache::register_directory(const std::string &directory_name) {
 	name = directory_name;
     }
 
-    for (auto &directory : cache_directories) {
-	auto length = std::min(name.length(), directory.name.length());
-
-	if (name.compare(0, length, directory.name) == 0 && (name.length() == length || name[length] == '/') && (directory.name.length() == length || directory.name[length] == '/')) {
-	    if (directory.name.length() != name.length()) {
-		output.error("can't cache in directory '%s' and its parent '%s'", (directory.name.length() < name.length() ? name.c_str() : directory.name.c_str()), (directory.name.length() < name.length() ? directory.name.c_str() : name.c_str()));
-		throw Exception();
-	    }
-	    return;
+    auto parent = find_directory(name);
+    if (parent != nullptr) {
+	if (parent->name.length() != name.length()) {
+	    output.error("can't cache in directory '%s' and its parent '%s'", name.c_str(), parent->name.c_str());
+	    throw Exception();
 	}
+	return;
+    }
+
+    auto prefix = name + "/";
+    auto it = cache_directory_index.lower_bound(prefix);
+    if (it != cache_directory_index.end() && it->first.compare(0, prefix.length(), prefix) == 0) {
+	output.error("can't cache in directory '%s' and its parent '%s'", it->first.c_str(), name.c_str());
+	throw Exception();
     }
 
+    cache_directory_index[name] = cache_directories.size();
     cache_directories.emplace_back(name);
 }
 
@@ -166,24 +234,21 @@ void CkmameCache::ensure_extra_maps() {
     /* Opening the archives will register them in the map. */
     extra_map_done = true;
 
+    std::vector<ArchiveLocation> archives;
     for (auto &entry : superfluous_delete_list->archives) {
-	auto file = entry.name;
-	switch ((name_type(file))) {
+	switch ((name_type(entry.name))) {
 	case NAME_IMAGES:
-	case NAME_ZIP: {
-            if (siginfo_caught) {
-                print_info("currently scanning '" + file + "'");
-            }
-	    auto a = Archive::open(file, entry.filetype, FILE_SUPERFLUOUS, 0);
+	case NAME_ZIP:
+	    archives.push_back(entry);
 	    // TODO: loose: add loose files in directory
 	    break;
-	}
 
 	default:
 	    // TODO: loose: add loose top level file
 	    break;
 	}
     }
+    open_archives(nullptr, archives, FILE_SUPERFLUOUS);
 
     if (siginfo_caught) {
         print_info("currently scanning '" + configuration.rom_directory + "'");
@@ -192,8 +257,22 @@ void CkmameCache::ensure_extra_maps() {
     auto a = Archive::open_toplevel(configuration.rom_directory, filetype, FILE_SUPERFLUOUS, 0);
 
 
+    std::unordered_set<std::string> scanned_directories;
     for (const auto &directory : configuration.extra_directories) {
-	enter_dir_in_map_and_list(extra_delete_list, directory, FILE_EXTRA);
+	if (configuration.open_extra_on_demand && open_directory_on_demand(directory)) {
+	    continue;
+	}
+	if (!scanned_directories.insert(directory).second) {
+	    enter_dir_in_map_and_list(extra_delete_list, directory, FILE_EXTRA);
+	    continue;
+	}
+	if (reuse_directory_scan(extra_delete_list, directory)) {
+	    continue;
+	}
+	auto last_id = ArchiveContents::last_id();
+	if (enter_dir_in_map_and_list(extra_delete_list, directory, FILE_EXTRA)) {
+	    save_directory_scan(extra_delete_list, directory, last_id);
+	}
     }
 
     extra_delete_list->sort_archives();
@@ -212,6 +291,151 @@ void CkmameCache::ensure_needed_maps() {
 }
 
 
+/* Open archives in extra directories opened on demand whose cached contents include a file that may match file. */
+void CkmameCache::open_extra_candidates(filetype_t filetype, const FileData *file) {
+    if (on_demand_directories.empty()) {
+	return;
+    }
+
+    extra_index_lookups += 1;
+
+    for (const auto &directory : on_demand_directories) {
+	auto dbh = get_db_for_archive(directory);
+	if (!dbh) {
+	    continue;
+	}
+
+	for (const auto &entry : dbh->find_archives(filetype, file->hashes)) {
+	    auto top_level = entry.name == ".";
+	    auto location = ArchiveLocation(top_level ? directory : directory + '/' + entry.name, entry.filetype);
+	    if (!opened_on_demand.insert(location).second) {
+		continue;
+	    }
+
+	    /* Opening the archive checks that it is unchanged since it was cached, rescanning it otherwise. */
+	    auto a = top_level ? Archive::open_toplevel(location.name, location.filetype, FILE_EXTRA, 0) : Archive::open(location.name, location.filetype, FILE_EXTRA, 0);
+	    if (a) {
+		extra_delete_list->add(a.get());
+		a->close();
+	    }
+	    else {
+		std::error_code ec;
+		if (!std::filesystem::exists(location.name, ec) && !ec) {
+		    /* clean up cache db: archive no longer in file system */
+		    dbh->delete_archive(location.name, location.filetype);
+		}
+	    }
+	}
+    }
+}
+
+
+/* Use cache database of directory_name to find files instead of scanning it. Not possible if it has none or it is empty. */
+bool CkmameCache::open_directory_on_demand(const std::string &directory_name) {
+    if (std::find(on_demand_directories.begin(), on_demand_directories.end(), directory_name) != on_demand_directories.end()) {
+	return true;
+    }
+
+    auto dbh = get_db_for_archive(directory_name);
+    if (!dbh || dbh->is_empty()) {
+	return false;
+    }
+
+    on_demand_directories.push_back(directory_name);
+    return true;
+}
+
+
+/* Forget scans of directories containing archive name, since it was changed. */
+void CkmameCache::archive_changed(const std::string &name) {
+    if (directory_scans.empty()) {
+	return;
+    }
+
+    auto path = normalized_path(name);
+    for (auto it = directory_scans.begin(); it != directory_scans.end();) {
+	if (paths_overlap(it->second.path, path)) {
+	    it = directory_scans.erase(it);
+	}
+	else {
+	    it++;
+	}
+    }
+}
+
+
+/* Enter archives found when scanning directory_name for a previous set in maps and list, if directory wasn't changed since. */
+bool CkmameCache::reuse_directory_scan(const DeleteListPtr &list, const std::string &directory_name) {
+    auto it = directory_scans.find(directory_name);
+    if (it == directory_scans.end() || !it->second.same_settings()) {
+	return false;
+    }
+    auto &scan = it->second;
+
+    for (const auto &entry : scan.archives) {
+	if (ArchiveContents::by_name(entry.contents->filetype, entry.contents->name)) {
+	    /* already opened in this run, can't reuse */
+	    return false;
+	}
+    }
+
+    auto measurement = Performance::Measurement(&performance, "reuse scanned archives", scan.archives.size());
+
+    for (const auto &entry : scan.archives) {
+	ArchiveContents::enter_in_maps(entry.contents);
+	if (entry.listed) {
+	    list->archives.emplace_back(entry.contents->name, entry.contents->filetype);
+	}
+    }
+
+    return true;
+}
+
+
+/* Remember archives entered in maps since last_id, which were found when scanning directory_name. */
+void CkmameCache::save_directory_scan(const DeleteListPtr &list, const std::string &directory_name, uint64_t last_id) {
+    auto &scan = directory_scans[directory_name];
+
+    scan.path = normalized_path(directory_name);
+    scan.set_settings();
+    scan.archives.clear();
+
+    auto listed = std::set<ArchiveLocation>(list->archives.begin(), list->archives.end());
+    for (auto id = last_id + 1; id <= ArchiveContents::last_id(); id++) {
+	auto contents = ArchiveContents::by_id(id);
+	if (contents) {
+	    scan.archives.emplace_back(contents, listed.find(ArchiveLocation(contents->name, contents->filetype)) != listed.end());
+	}
+    }
+}
+
+
+/* Detectors used by the current set, by global id. */
+static std::set<size_t> current_detector_ids() {
+    std::set<size_t> ids;
+
+    if (db) {
+	for (const auto &pair : db->detectors) {
+	    ids.insert(pair.first);
+	}
+    }
+
+    return ids;
+}
+
+
+void CkmameCache::DirectoryScan::set_settings() {
+    roms_zipped = configuration.roms_zipped;
+    hash_extra_on_demand = configuration.hash_extra_on_demand;
+    detector_ids = current_detector_ids();
+}
+
+
+bool CkmameCache::DirectoryScan::same_settings() const {
+    return roms_zipped == configuration.roms_zipped && hash_extra_on_demand == configuration.hash_extra_on_demand && detector_ids == current_detector_ids();
+}
+
+
 bool CkmameCache::enter_dir_in_map_and_list(const DeleteListPtr &list, const std::string &directory_name, where_t where) {
     bool ret;
     if (configuration.roms_zipped) {
@@ -250,22 +474,17 @@ bool CkmameCache::enter_dir_in_map_and_list_unzipped(const DeleteListPtr &list,
     try {
 	Dir dir(directory_name, false);
 	std::filesystem::path filepath;
+	std::vector<ArchiveLocation> archives;
 
 	while (!(filepath = dir.next()).empty()) {
 	    if (name_type(filepath) == NAME_IGNORE) {
 		continue;
 	    }
 	    if (std::filesystem::is_directory(filepath)) {
-                if (siginfo_caught) {
-                    print_info("currently scanning '" + filepath.string() + "'");
-                }
-		auto a = Archive::open(filepath, TYPE_ROM, where, 0);
-		if (a) {
-		    list->add(a.get());
-		    a->close();
-		}
+		archives.emplace_back(filepath, TYPE_ROM);
 	    }
 	}
+	open_archives(list, archives, where);
 
         if (siginfo_caught) {
             print_info("currently scanning '" + directory_name + "'");
@@ -287,10 +506,25 @@ bool CkmameCache::enter_dir_in_map_and_list_zipped(const DeleteListPtr &list, co
     try {
 	Dir dir(dir_name, true);
 	std::filesystem::path filepath;
+	std::vector<ArchiveLocation> archives;
 
 	while (!(filepath = dir.next()).empty()) {
-	    enter_file_in_map_and_list(list, filepath, where);
+	    switch (name_type(filepath)) {
+	    case NAME_IMAGES:
+		archives.emplace_back(filepath, TYPE_DISK);
+		break;
+
+	    case NAME_ZIP:
+		archives.emplace_back(filepath, TYPE_ROM);
+		break;
+
+	    case NAME_IGNORE:
+	    case NAME_UNKNOWN:
+		// TODO: loose: add unknown files?
+		break;
+	    }
 	}
+	open_archives(list, archives, where);
 
         if (siginfo_caught) {
             print_info("currently scanning '" + dir_name + "'");
@@ -308,30 +542,69 @@ bool CkmameCache::enter_dir_in_map_and_list_zipped(const DeleteListPtr &list, co
 }
 
 
-bool CkmameCache::enter_file_in_map_and_list(const DeleteListPtr &list, const std::string &name, where_t where) {
-    name_type_t nt;
+/* Open archives, add them to list (if given) in the given order, and close them.
+   With jobs, hashes of the archives' files are computed in parallel, one batch of archives at a time;
+   the archives are entered into memdb in order once their hashes are known. */
+void CkmameCache::open_archives(const DeleteListPtr &list, const std::vector<ArchiveLocation> &archives, where_t where) {
+    auto measurement = Performance::Measurement(&performance, "scan archives", archives.size());
 
-    switch ((nt = name_type(name))) {
-    case NAME_IMAGES:
-    case NAME_ZIP: {
-        if (siginfo_caught) {
-            print_info("currently scanning '" + name + "'");
-        }
-	auto a = Archive::open(name, nt == NAME_ZIP ? TYPE_ROM : TYPE_DISK, where, 0);
-	if (a) {
-	    list->add(a.get());
-	    a->close();
+    if (configuration.jobs <= 1) {
+	for (const auto &location : archives) {
+	    exit_if_interrupted();
+	    if (siginfo_caught) {
+		print_info("currently scanning '" + location.name + "'");
+	    }
+	    auto a = Archive::open(location.name, location.filetype, where, 0);
+	    if (a && list) {
+		list->add(a.get());
+		a->close();
+	    }
 	}
-	break;
+	return;
     }
 
-    case NAME_IGNORE:
-    case NAME_UNKNOWN:
-	// TODO: loose: add unknown files?
-	break;
-    }
+    auto pool = WorkerPool(configuration.jobs);
+    auto batch_size = configuration.jobs * SCAN_BATCH_SIZE_PER_JOB;
 
-    return true;
+    for (size_t start = 0; start < archives.size(); start += batch_size) {
+	exit_if_interrupted();
+	auto end = std::min(start + batch_size, archives.size());
+	std::vector<ArchivePtr> batch;
+	std::vector<std::vector<std::optional<Hashes>>> hashes(end - start);
+
+	for (auto i = start; i < end; i++) {
+	    if (siginfo_caught) {
+		print_info("currently scanning '" + archives[i].name + "'");
+	    }
+	    batch.push_back(Archive::open(archives[i].name, archives[i].filetype, where, ARCHIVE_FL_DEFER_HASHES));
+	}
+
+	for (size_t i = 0; i < batch.size(); i++) {
+	    auto archive = batch[i].get();
+	    if (archive && !archive->deferred_hashes.empty()) {
+		/* one job per archive, since archives can't be read from several threads */
+		auto result = &hashes[i];
+		pool.add([archive, result]() {
+		    for (auto index : archive->deferred_hashes) {
+			result->push_back(archive->file_compute_hashes(index));
+		    }
+		});
+	    }
+	}
+	pool.wait();
+	exit_if_interrupted();
+
+	for (size_t i = 0; i < batch.size(); i++) {
+	    auto &archive = batch[i];
+	    if (archive) {
+		archive->finish_deferred_hashes(hashes[i]);
+		if (list) {
+		    list->add(archive.get());
+		    archive->close();
+		}
+	    }
+	}
+    }
 }
 
 
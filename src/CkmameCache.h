@@ -34,6 +34,11 @@ OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
 IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string_view>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "CkmameDB.h"
@@ -43,10 +48,12 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 class CkmameCache {
   public:
     CkmameCache();
-    ~CkmameCache() { close_all(); }
+    ~CkmameCache();
 
     void ensure_extra_maps();
     void ensure_needed_maps();
+    void flush_databases(bool only_due);
+    void open_extra_candidates(filetype_t filetype, const FileData *file);
 
     CkmameDBPtr get_db_for_archive(const std::string &name);
     std::string get_directory_name_for_archive(const std::string &name);
@@ -54,6 +61,8 @@ class CkmameCache {
 
     void used(Archive *a, size_t idx);
 
+    static void archive_changed(const std::string &name);
+
     DeleteListPtr extra_delete_list;
     DeleteListPtr needed_delete_list;
     DeleteListPtr superfluous_delete_list;
@@ -72,18 +81,54 @@ class CkmameCache {
 	explicit CacheDirectory(std::string name_): name(std::move(name_)), initialized(false) { }
     };
 
+    /* Archives found when scanning an extra directory, kept across sets until the directory changes. */
+    class DirectoryScan {
+      public:
+	class Entry {
+	  public:
+	    Entry(ArchiveContentsPtr contents_, bool listed_) : contents(std::move(contents_)), listed(listed_) { }
+
+	    ArchiveContentsPtr contents;
+	    bool listed; // archive was added to delete list
+	};
+
+	std::filesystem::path path;
+	/* settings that affect which archives are found and which hashes they have */
+	bool roms_zipped;
+	bool hash_extra_on_demand;
+	std::set<size_t> detector_ids;
+	std::vector<Entry> archives;
+
+	void set_settings();
+	[[nodiscard]] bool same_settings() const;
+    };
+
+    static std::unordered_map<std::string, DirectoryScan> directory_scans;
+
     bool close_all();
 
     std::vector<CacheDirectory> cache_directories;
+    std::map<std::string, size_t, std::less<>> cache_directory_index; // name -> index in cache_directories
 
     bool extra_map_done;
     bool needed_map_done;
 
+    /* counted here and added to performance report when done */
+    uint64_t directory_lookups;
+    uint64_t extra_index_lookups;
+
+    std::vector<std::string> on_demand_directories; // extra directories not scanned, archives are opened when their cached contents match a searched file
+    std::set<ArchiveLocation> opened_on_demand;
+
     bool enter_dir_in_map_and_list(const DeleteListPtr &list, const std::string &directory_name, where_t where);
     static bool enter_dir_in_map_and_list_unzipped(const DeleteListPtr &list, const std::string &directory_name, where_t where);
     static bool enter_dir_in_map_and_list_zipped(const DeleteListPtr &list, const std::string &dir_name, where_t where);
-    static bool enter_file_in_map_and_list(const DeleteListPtr &list, const std::string &name, where_t where);
+    static void open_archives(const DeleteListPtr &list, const std::vector<ArchiveLocation> &archives, where_t where);
+    static bool reuse_directory_scan(const DeleteListPtr &list, const std::string &directory_name);
+    static void save_directory_scan(const DeleteListPtr &list, const std::string &directory_name, uint64_t last_id);
 
+    bool open_directory_on_demand(const std::string &directory_name);
+    CacheDirectory *find_directory(std::string_view name);
     const CacheDirectory* get_directory_for_archive(const std::string &name);
 };
 
@@ -39,8 +39,14 @@
     #include "Detector.h"
     #include "Exception.h"
     #include "fix.h"
+#include "Performance.h"
+
+/* Writes are collected in transactions of about this many rows, kept open for at most this long. */
+#define MAX_ROWS_PER_TRANSACTION 10000
+#define MAX_TRANSACTION_DURATION std::chrono::seconds(1)
 
     const std::string CkmameDB::db_name = ".ckmame.db";
+    bool CkmameDB::write_ahead_log = false;
 
     const DB::DBFormat CkmameDB::format = {
 	0x02,
@@ -114,10 +120,18 @@
 	{ QUERY_HAS_ARCHIVES, "select archive_id from archive limit 1" }
     };
 
+    std::unordered_map<int, std::string> CkmameDB::parameterized_queries = {
+	{ QUERY_ARCHIVE_FBH, "select name, file_type from archive where file_type = :file_type and archive_id in (select f.archive_id from file f where 1 @SIZE@ @HASH@)" }
+    };
+
     CkmameDB::CkmameDB(const std::string& directory) : CkmameDB(make_db_file_name(directory, db_name, configuration.extra_directory_use_central_cache_directory(directory)), directory) {
     }
 
-    CkmameDB::CkmameDB(const std::string &dbname, std::string directory_) : DB(format, dbname, DBH_CREATE | DBH_WRITE), directory(std::move(directory_)) {
+    CkmameDB::CkmameDB(const std::string &dbname, std::string directory_) : DB(format, dbname, DBH_CREATE | DBH_WRITE), directory(std::move(directory_)), rows_in_transaction(0) {
+	if (write_ahead_log) {
+	    set_write_ahead_log();
+	}
+
 	auto stmt = get_statement(LIST_DETECTORS);
 
 	while (stmt->step()) {
@@ -126,9 +140,48 @@
     }
 
 
+    CkmameDB::~CkmameDB() {
+	/* Not measured, this may run during exit when performance is already gone. */
+	try {
+	    if (in_transaction()) {
+		commit_transaction();
+	    }
+	    if (write_ahead_log) {
+		unset_write_ahead_log();
+	    }
+	}
+	catch (Exception &e) {
+	    output.error_database("can't write cache database for '%s': %s", directory.c_str(), e.what());
+	}
+    }
+
+
+    void CkmameDB::flush() {
+	if (!in_transaction()) {
+	    return;
+	}
+
+	auto measurement = Performance::Measurement(&performance, "cache database writes");
+	commit_transaction();
+	rows_in_transaction = 0;
+    }
+
+
+    /* Commit pending writes if the transaction has been open too long, so other processes aren't locked out. */
+    void CkmameDB::flush_if_due() {
+	if (in_transaction() && std::chrono::steady_clock::now() - transaction_start >= MAX_TRANSACTION_DURATION) {
+	    flush();
+	}
+    }
+
+
     std::string CkmameDB::get_query(int name, bool parameterized) const {
 	if (parameterized) {
-	    return "";
+	    auto it = parameterized_queries.find(name);
+	    if (it == parameterized_queries.end()) {
+		return "";
+	    }
+	    return it->second;
 	}
 	else {
 	    auto it = queries.find(static_cast<Statement>(name));
@@ -141,12 +194,16 @@
 
 
     void CkmameDB::delete_archive(int id) {
+	begin_write();
+
 	delete_files(id);
 
 	auto stmt = get_statement(DELETE_ARCHIVE);
 
 	stmt->set_int("archive_id", id);
 	stmt->execute();
+
+	end_write(1);
     }
 
 
@@ -198,6 +255,26 @@
     }
 
 
+    /* Returns archives of filetype containing a file that may match hashes, using the indexes on the file table. */
+    std::vector<ArchiveLocation> CkmameDB::find_archives(filetype_t filetype, const Hashes &hashes) {
+	auto have_size = hashes.size != Hashes::SIZE_UNKNOWN;
+	auto stmt = get_statement(QUERY_ARCHIVE_FBH, hashes, have_size);
+	std::vector<ArchiveLocation> archives;
+
+	stmt->set_int("file_type", filetype);
+	if (have_size) {
+	    stmt->set_uint64("size", hashes.size);
+	}
+	stmt->set_hashes(hashes, false);
+
+	while (stmt->step()) {
+	    archives.emplace_back(stmt->get_string("name"), static_cast<filetype_t>(stmt->get_int("file_type")));
+	}
+
+	return archives;
+    }
+
+
     bool CkmameDB::is_empty() {
 	auto stmt = get_statement(QUERY_HAS_ARCHIVES);
 
@@ -267,6 +344,11 @@
 
 
     void CkmameDB::write_archive(ArchiveContents *archive) {
+	auto measurement = Performance::Measurement(&performance, "cache database writes");
+	uint64_t rows = 1;
+
+	begin_write();
+
 	auto id = archive->cache_id;
 
 	if (id == 0) {
@@ -300,6 +382,7 @@
 
 	    stmt->execute();
 	    stmt->reset();
+	    rows += 1;
 
 	    for (auto &pair : file.detector_hashes) {
 		auto detector_id = get_detector_id(pair.first);
@@ -315,10 +398,33 @@
 
 		stmt->execute();
 		stmt->reset();
+		rows += 1;
 	    }
 	}
 
 	archive->cache_id = id;
+
+	measurement.add(rows);
+	end_write(rows);
+    }
+
+
+    void CkmameDB::begin_write() {
+	if (!in_transaction()) {
+	    begin_transaction();
+	    transaction_start = std::chrono::steady_clock::now();
+	}
+    }
+
+
+    void CkmameDB::end_write(uint64_t rows) {
+	rows_in_transaction += rows;
+	if (rows_in_transaction >= MAX_ROWS_PER_TRANSACTION) {
+	    flush();
+	}
+	else {
+	    flush_if_due();
+	}
     }
 
 
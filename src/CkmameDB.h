@@ -33,6 +33,7 @@
  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <chrono>
 #include <memory>
 #include <string>
 #include <utility>
@@ -64,18 +65,26 @@ public:
         QUERY_FILE,
         QUERY_HAS_ARCHIVES
     };
+
+    enum ParameterizedStatement {
+        QUERY_ARCHIVE_FBH
+    };
     
     explicit CkmameDB(const std::string& directory);
     CkmameDB(const std::string& dbname, std::string directory); // used in dbrestore
-    ~CkmameDB() override = default;
+    ~CkmameDB() override;
 
     static const DBFormat format;
     static const std::string db_name;
+    static bool write_ahead_log;
 
     void delete_archive(const std::string &name, filetype_t filetype);
     void delete_archive(int id);
+    void flush();
+    void flush_if_due();
     int get_archive_id(const std::string &name, filetype_t filetype);
     void get_last_change(int id, time_t *mtime, off_t *size);
+    std::vector<ArchiveLocation> find_archives(filetype_t filetype, const Hashes &hashes);
     bool is_empty();
     std::vector<ArchiveLocation> list_archives();
     int read_files(int archive_id, std::vector<File> *files);
@@ -88,13 +97,19 @@ protected:
     
 private:
     static std::unordered_map<Statement, std::string> queries;
+    static std::unordered_map<int, std::string> parameterized_queries;
 
     std::string directory;
     DetectorCollection detector_ids;
+    uint64_t rows_in_transaction;
+    std::chrono::steady_clock::time_point transaction_start;
     
     DBStatement *get_statement(Statement name) { return get_statement_internal(name); }
+    DBStatement *get_statement(ParameterizedStatement name, const Hashes &hashes, bool have_size) { return get_statement_internal(name, hashes, have_size); }
 
     std::string name_in_db(const std::string &name);
+    void begin_write();
+    void end_write(uint64_t rows);
     void delete_files(int id);
     int write_archive_header(int id, const std::string &name, filetype_t filetype, time_t mtime, uint64_t size);
     
@@ -33,12 +33,60 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "Command.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+
 #include <fnmatch.h>
 
 #include "config.h"
 
+#ifdef HAVE_FORK
+#include <csignal>
+
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 #include "Exception.h"
 #include "globals.h"
+#include "sighandle.h"
+#include "util.h"
+
+#ifdef HAVE_FORK
+namespace {
+/* Output of one set, buffered while it is processed in a separate process. */
+class SetOutput {
+  public:
+    SetOutput();
+    SetOutput(const SetOutput&) = delete;
+    ~SetOutput();
+
+    void redirect() const;
+    bool replay(bool separate) const;
+
+  private:
+    FILE* out;
+    FILE* err;
+
+    static void copy(FILE* from, FILE* to);
+};
+
+/* Files and directories a set uses, split into those it writes to and those it only reads. */
+class SetPaths {
+  public:
+    std::vector<std::filesystem::path> written;
+    std::vector<std::filesystem::path> read;
+
+    [[nodiscard]] bool conflicts_with(const SetPaths& other) const;
+};
+
+SetPaths set_paths(bool updates_dat_directories);
+} // namespace
+#endif
 
 Command::Command(std::string name, std::string arguments, std::vector<Commandline::Option> options,
                  std::unordered_set<std::string> used_variables)
@@ -113,11 +161,21 @@ int Command::run(int argc, char* const* argv) {
         }
         else {
             auto multi_set = selected_sets.size() > 1;
-            for (const auto& set : selected_sets) {
-                if (!do_for(set, arguments, multi_set)) {
+#ifdef HAVE_FORK
+            if (multi_set && configuration.jobs > 1) {
+                if (!do_for_parallel(selected_sets, arguments)) {
                     exit_code = 1;
                 }
             }
+            else
+#endif
+            {
+                for (const auto& set : selected_sets) {
+                    if (!do_for(set, arguments, multi_set)) {
+                        exit_code = 1;
+                    }
+                }
+            }
         }
     }
     catch (std::exception& ex) {
@@ -162,3 +220,267 @@ bool Command::do_for(const std::string& set, const ParsedCommandline& arguments,
         return false;
     }
 }
+
+
+#ifdef HAVE_FORK
+/* Process sets in up to configuration.jobs child processes, each with its own global state.
+   Sets that write to files or directories another set uses are processed one after the other in the same child.
+   Output of each set is buffered and printed in order of sets.
+   On SIGINT or SIGTERM, the signal is forwarded to the children, no more sets are started, and the output of started sets is printed before exiting. */
+bool Command::do_for_parallel(const std::set<std::string>& sets, const ParsedCommandline& arguments) {
+    auto set_names = std::vector<std::string>(sets.begin(), sets.end());
+
+    std::vector<SetPaths> paths;
+    for (const auto& set : set_names) {
+        try {
+            configuration.prepare(set, arguments);
+            paths.push_back(set_paths(updates_dat_directories()));
+        }
+        catch (std::exception& ex) {
+            /* error is reported when processing set */
+            paths.emplace_back();
+        }
+    }
+
+    /* conflicting sets end up in the same group, which is processed by one child */
+    std::vector<size_t> parent(set_names.size());
+    auto find = [&parent](size_t index) {
+        while (parent[index] != index) {
+            index = parent[index];
+        }
+        return index;
+    };
+    for (size_t i = 0; i < set_names.size(); i++) {
+        parent[i] = i;
+        for (size_t j = 0; j < i; j++) {
+            if (paths[i].conflicts_with(paths[j])) {
+                parent[find(i)] = find(j);
+            }
+        }
+    }
+
+    std::vector<std::vector<size_t>> groups;
+    std::unordered_map<size_t, size_t> group_index;
+    for (size_t i = 0; i < set_names.size(); i++) {
+        auto it = group_index.find(find(i));
+        if (it == group_index.end()) {
+            group_index[find(i)] = groups.size();
+            groups.emplace_back();
+            groups.back().push_back(i);
+        }
+        else {
+            groups[it->second].push_back(i);
+        }
+    }
+
+    auto processes = std::min(configuration.jobs, groups.size());
+    auto jobs_per_process = std::max(configuration.jobs / processes, size_t{1});
+
+    std::vector<SetOutput> outputs(set_names.size());
+    std::vector<bool> started(set_names.size());
+    std::vector<bool> done(set_names.size());
+    std::unordered_map<pid_t, size_t> running;
+    size_t next_group = 0;
+    size_t next_output = 0;
+    auto separate = false;
+    auto ok = true;
+
+    fflush(stdout);
+    fflush(stderr);
+
+    /* without SA_RESTART, so waitpid() returns when interrupted */
+    struct sigaction action = {};
+    action.sa_handler = sighandle;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    auto forwarded = false;
+
+    while ((next_group < groups.size() && !interrupt_caught) || !running.empty()) {
+        while (next_group < groups.size() && running.size() < processes && !interrupt_caught) {
+            auto pid = fork();
+            if (pid < 0) {
+                if (running.empty()) {
+                    restore_interrupt_handlers();
+                    throw Exception("can't create process: %s", strerror(errno));
+                }
+                break;
+            }
+            if (pid == 0) {
+                /* interrupts from the terminal only reach the parent, which forwards them once */
+                setpgid(0, 0);
+                restore_interrupt_handlers();
+                configuration.jobs = jobs_per_process;
+                auto child_ok = true;
+                for (auto index : groups[next_group]) {
+                    fflush(stdout);
+                    fflush(stderr);
+                    outputs[index].redirect();
+                    output.restart_headers();
+                    if (!do_for(set_names[index], arguments, true)) {
+                        child_ok = false;
+                    }
+                }
+                fflush(stdout);
+                fflush(stderr);
+                _exit(child_ok ? 0 : 1);
+            }
+            running[pid] = next_group;
+            for (auto index : groups[next_group]) {
+                started[index] = true;
+            }
+            next_group += 1;
+        }
+
+        if (interrupt_caught && !forwarded) {
+            for (const auto& pair : running) {
+                kill(pair.first, interrupt_caught);
+            }
+            forwarded = true;
+        }
+        if (running.empty()) {
+            break;
+        }
+
+        int status;
+        auto pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            restore_interrupt_handlers();
+            throw Exception("can't wait for process: %s", strerror(errno));
+        }
+        auto it = running.find(pid);
+        if (it == running.end()) {
+            continue;
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            ok = false;
+        }
+        for (auto index : groups[it->second]) {
+            done[index] = true;
+        }
+        running.erase(it);
+
+        while (next_output < set_names.size() && done[next_output]) {
+            if (outputs[next_output].replay(separate)) {
+                separate = true;
+            }
+            next_output += 1;
+        }
+    }
+
+    /* when interrupted, print what the started sets output before they stopped */
+    for (; next_output < set_names.size(); next_output++) {
+        if (started[next_output] && outputs[next_output].replay(separate)) {
+            separate = true;
+        }
+    }
+
+    restore_interrupt_handlers();
+    exit_if_interrupted();
+
+    return ok;
+}
+
+
+namespace {
+SetOutput::SetOutput() : out(tmpfile()), err(tmpfile()) {
+    if (out == nullptr || err == nullptr) {
+        auto error = std::string(strerror(errno));
+        if (out != nullptr) {
+            fclose(out);
+        }
+        if (err != nullptr) {
+            fclose(err);
+        }
+        throw Exception("can't create temporary file: " + error);
+    }
+}
+
+
+SetOutput::~SetOutput() {
+    fclose(out);
+    fclose(err);
+}
+
+
+void SetOutput::redirect() const {
+    dup2(fileno(out), STDOUT_FILENO);
+    dup2(fileno(err), STDERR_FILENO);
+}
+
+
+/* Print buffered output, separated from previous output by an empty line. Returns whether anything was printed to stdout. */
+bool SetOutput::replay(bool separate) const {
+    fseek(out, 0, SEEK_END);
+    auto have_output = ftell(out) > 0;
+
+    if (have_output && separate) {
+        printf("\n");
+    }
+    copy(out, stdout);
+    copy(err, stderr);
+
+    return have_output;
+}
+
+
+void SetOutput::copy(FILE* from, FILE* to) {
+    char buffer[BUFSIZ];
+    size_t n;
+
+    fflush(to);
+    rewind(from);
+    while ((n = fread(buffer, 1, sizeof(buffer), from)) > 0) {
+        fwrite(buffer, 1, n, to);
+    }
+    fflush(to);
+}
+
+
+/* Whether either set writes to files or directories the other one uses. */
+bool SetPaths::conflicts_with(const SetPaths& other) const {
+    auto overlaps = [](const std::vector<std::filesystem::path>& paths, const std::vector<std::filesystem::path>& other_paths) {
+        return std::any_of(paths.begin(), paths.end(), [&other_paths](const std::filesystem::path& path) {
+            return std::any_of(other_paths.begin(), other_paths.end(), [&path](const std::filesystem::path& other_path) { return paths_overlap(path, other_path); });
+        });
+    };
+
+    return overlaps(written, other.written) || overlaps(written, other.read) || overlaps(read, other.written);
+}
+
+
+/* Files and directories the current set uses.
+   Cache databases in extra directories only read from are written by all sets, but SQLite serializes those writes. */
+SetPaths set_paths(bool updates_dat_directories) {
+    SetPaths paths;
+
+    auto add = [](std::vector<std::filesystem::path>& list, const std::string& name) {
+        if (name.empty()) {
+            return;
+        }
+        list.push_back(normalized_path(name));
+    };
+
+    add(paths.written, configuration.rom_db);
+    add(paths.written, configuration.rom_directory);
+    if (configuration.fix_romset) {
+        add(paths.written, configuration.saved_directory);
+        add(paths.written, configuration.unknown_directory);
+    }
+    add(paths.written, configuration.complete_list);
+    add(paths.written, configuration.missing_list);
+    for (const auto& directory : configuration.extra_directories) {
+        add(configuration.fix_romset && configuration.extra_directory_move_from_extra(directory) ? paths.written : paths.read, directory);
+    }
+    for (const auto& directory : configuration.dat_directories) {
+        add(updates_dat_directories ? paths.written : paths.read, directory);
+    }
+
+    return paths;
+}
+
+} // namespace
+#endif
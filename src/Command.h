@@ -34,6 +34,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef COMMAND_H
 #define COMMAND_H
 
+#include <set>
 #include <string>
 #include <unordered_set>
 
@@ -51,6 +52,7 @@ class Command {
     virtual bool execute(const std::vector<std::string>& arguments) = 0;
     virtual bool cleanup() { return true; }
     virtual bool global_cleanup() { return true; }
+    [[nodiscard]] virtual bool updates_dat_directories() const { return false; } // for the current set, whether caches in dat directories are written
 
     std::string name;
     std::string arguments;
@@ -59,6 +61,7 @@ class Command {
 
   private:
     bool do_for(const std::string& set, const ParsedCommandline& arguments, bool multi_set_invocation = false);
+    bool do_for_parallel(const std::set<std::string>& sets, const ParsedCommandline& arguments);
 };
 
 
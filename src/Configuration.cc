@@ -98,10 +98,12 @@ TomlSchema::TypePtr Configuration::section_schema = TomlSchema::table({
     { "extra-directories", extra_directories_schema},
     { "extra-directories-append", extra_directories_schema},
     { "fixdat-directory",  TomlSchema::string() },
+    { "hash-extra-on-demand",  TomlSchema::boolean() },
     { "keep-old-duplicate",  TomlSchema::boolean() },
     { "missing-list", TomlSchema::string() },
     { "move-from-extra",  TomlSchema::boolean() },
     { "old-db", TomlSchema::string() },
+    { "open-extra-on-demand",  TomlSchema::boolean() },
     { "profiles", TomlSchema::array(TomlSchema::string()) },
     { "report-changes",  TomlSchema::boolean() },
     { "report-correct",  TomlSchema::boolean() },
@@ -140,6 +142,7 @@ std::vector<Commandline::Option> Configuration::commandline_options = {
     Commandline::Option("delete-unknown-pattern", "pattern", "delete unknown files matching 'pattern'"),
     Commandline::Option("extra-directory", 'e', "dir", "search for missing files in directory dir (multiple directories can be specified by repeating this option)"),
     Commandline::Option("fixdat-directory", "directory", "create fixdats in directory"),
+    Commandline::Option("hash-extra-on-demand", "compute hashes of files in extra directories only when needed"),
     Commandline::Option("keep-old-duplicate", "keep files in ROM set that are also in old ROMs"),
     Commandline::Option("list-sets", "list all known sets"),
     Commandline::Option("missing-list", "file", "write list of missing games to file"),
@@ -155,6 +158,7 @@ std::vector<Commandline::Option> Configuration::commandline_options = {
     Commandline::Option("no-report-summary", "don't print summary of ROM set status (default)"),
     Commandline::Option("no-update-database", "don't update ROM database (default)"),
     Commandline::Option("old-db", 'O', "dbfile", "use database dbfile for old ROMs"),
+    Commandline::Option("open-extra-on-demand", "only open archives in extra directories whose cached contents match a missing file"),
     Commandline::Option("report-changes", "report changes to correct and missing lists"),
     Commandline::Option("report-correct", 'c', "report status of ROMs that are correct"),
     Commandline::Option("report-detailed", "report status of every ROM"),
@@ -230,7 +234,7 @@ bool Configuration::option_used(const std::string &option_name, const std::unord
 }
 
 
-Configuration::Configuration() : fix_romset(false) {
+Configuration::Configuration() : fix_romset(false), jobs(1), report_performance(false) {
     reset();
 }
 
@@ -239,10 +243,12 @@ void Configuration::reset() {
     complete_list = "";
     create_fixdat = false;
     delete_unknown_pattern = "";
+    hash_extra_on_demand = false;
     keep_old_duplicate = false;
     missing_list = "";
     move_from_extra = false;
     old_db = RomDB::default_old_name();
+    open_extra_on_demand = false;
     report_correct = false;
     report_changes = false;
     report_detailed = false;
@@ -401,6 +407,9 @@ void Configuration::prepare(const std::string &current_set, const ParsedCommandl
         else if (option.name == "fixdat-directory") {
             fixdat_directory = option.argument;
         }
+        else if (option.name == "hash-extra-on-demand") {
+            hash_extra_on_demand = true;
+        }
         else if (option.name == "keep-old-duplicate") {
             keep_old_duplicate = true;
         }
@@ -443,6 +452,9 @@ void Configuration::prepare(const std::string &current_set, const ParsedCommandl
         else if (option.name == "old-db") {
             old_db = option.argument;
         }
+        else if (option.name == "open-extra-on-demand") {
+            open_extra_on_demand = true;
+        }
         else if (option.name == "report-changes") {
             report_changes = true;
         }
@@ -538,10 +550,12 @@ void Configuration::merge_config_table(const toml::table *table_pointer) {
     merge_extra_directories(table, "extra-directories", false);
     merge_extra_directories(table, "extra-directories-append", true);
     set_string(table, "fixdat-directory", fixdat_directory);
+    set_bool(table, "hash-extra-on-demand", hash_extra_on_demand);
     set_bool(table, "keep-old-duplicate", keep_old_duplicate);
     set_string(table, "missing-list", missing_list);
     set_bool(table, "move-from-extra", move_from_extra);
     set_string(table, "old-db", old_db);
+    set_bool(table, "open-extra-on-demand", open_extra_on_demand);
     set_bool(table, "report-changes", report_changes);
     set_bool(table, "report-correct", report_correct);
     set_bool(table, "report-detailed", report_detailed);
@@ -98,10 +98,12 @@ public:
     std::string delete_unknown_pattern;
     std::vector<std::string> extra_directories;
     std::string fixdat_directory;
+    bool hash_extra_on_demand; // only compute hashes of files in extra directories when a ROM of that size is searched for
     bool keep_old_duplicate;
     std::string missing_list;
     bool move_from_extra; // remove files taken from extra directories, otherwise copy them and don't change extra directory.
     std::string old_db;
+    bool open_extra_on_demand; // find files in extra directories via their cache databases, only opening archives that match
     bool report_changes; /* report changes to complete or missing lists */
     bool report_correct; /* report ROMs that are correct */
     bool report_detailed; /* one line for each ROM */
@@ -128,6 +130,8 @@ public:
 
     // not in config files, per invocation
     bool fix_romset; // actually fix, otherwise no archive is changed
+    size_t jobs; // number of worker threads
+    bool report_performance; // print timing of bulk operations
 
 private:
     class DatDirectoryOptions {
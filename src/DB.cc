@@ -58,6 +58,7 @@ static const char *format_name[] = {
 #define SET_VERSION_FMT "pragma user_version = %d"
 
 #define PRAGMAS "PRAGMA synchronous = OFF; "
+#define BUSY_TIMEOUT 60000 /* milliseconds */
 
 const std::unordered_map<MigrationVersions, std::string> DB::no_migrations = { };
 
@@ -90,7 +91,7 @@ int DB::get_version(const DBFormat &format) const {
 }
 
 
-void DB::check_version(const DBFormat &format) {
+void DB::check_version(const DBFormat &format, bool read_only) {
     auto db_version = get_version(format);
         
     if (db_version == format.version) {
@@ -100,6 +101,10 @@ void DB::check_version(const DBFormat &format) {
     if (db_version > format.version) {
         throw Exception("database version too new: %d, expected %d", db_version, format.version);
     }
+
+    if (read_only && format.oldest_readable_version > 0 && db_version >= format.oldest_readable_version) {
+        return;
+    }
     
     migrate(format, db_version, format.version);
 }
@@ -198,6 +203,9 @@ void DB::open(const DBFormat &format, const std::string &name, int sql3_flags, b
         throw Exception("%s", sqlite3_errmsg(db));
     }
 
+    /* sets processed in parallel share cache databases of extra directories */
+    sqlite3_busy_timeout(db, BUSY_TIMEOUT);
+
     if (sqlite3_exec(db, PRAGMAS, nullptr, nullptr, nullptr) != SQLITE_OK) {
         throw Exception("can't set options: %s", sqlite3_errmsg(db));
     }
@@ -206,11 +214,42 @@ void DB::open(const DBFormat &format, const std::string &name, int sql3_flags, b
         upgrade(format.id, format.version, format.init_sql);
     }
     else {
-        check_version(format);
+        check_version(format, (sql3_flags & SQLITE_OPEN_READWRITE) == 0);
     }
 }
 
 
+void DB::begin_transaction() {
+    if (sqlite3_exec(db, "begin transaction", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        throw Exception("can't begin transaction: %s", sqlite3_errmsg(db));
+    }
+}
+
+
+void DB::commit_transaction() {
+    if (sqlite3_exec(db, "commit transaction", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        auto error = std::string(sqlite3_errmsg(db));
+        sqlite3_exec(db, "rollback transaction", nullptr, nullptr, nullptr);
+        throw Exception("can't commit transaction: %s", error.c_str());
+    }
+}
+
+
+void DB::set_write_ahead_log() {
+    if (sqlite3_exec(db, "pragma journal_mode = wal", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        throw Exception("can't set journal mode: %s", sqlite3_errmsg(db));
+    }
+}
+
+
+/* Switch back to the default rollback journal, so the mode doesn't persist in the database file.
+   This fails if another connection still uses the database; that one switches back when it is closed. */
+void DB::unset_write_ahead_log() {
+    sqlite3_busy_timeout(db, 0);
+    sqlite3_exec(db, "pragma journal_mode = delete", nullptr, nullptr, nullptr);
+}
+
+
 std::filesystem::path DB::make_db_file_name(const std::filesystem::path &directory, const std::string &name, bool use_central_cache) {
     if (!use_central_cache) {
         return directory / name;
@@ -112,6 +112,7 @@ public:
         int version;
         std::string init_sql;
         std::unordered_map<MigrationVersions, std::string> migrations;
+        int oldest_readable_version = 0; // older versions can be opened read-only without migrating, if not 0
     };
 
     DB(const DBFormat &format, const std::string &name, int mode);
@@ -120,6 +121,12 @@ public:
     sqlite3 *db;
     
     [[nodiscard]] std::string error() const;
+
+    void begin_transaction();
+    void commit_transaction();
+    [[nodiscard]] bool in_transaction() const { return sqlite3_get_autocommit(db) == 0; }
+    void set_write_ahead_log();
+    void unset_write_ahead_log();
     
     // This is used by dbrestore to create databases with arbitrary schema and version.
     static void upgrade(sqlite3 *db, int format, int version, const std::string &statement);
@@ -147,7 +154,7 @@ private:
     DBStatement *get_statement_internal(StatementID statement_id);
     
     [[nodiscard]] int get_version(const DBFormat &format) const;
-    void check_version(const DBFormat &format);
+    void check_version(const DBFormat &format, bool read_only);
     void open(const DBFormat &format, const std::string &name, int sql3_flags, bool needs_init);
     void close();
     void migrate(const DBFormat &format, int from_version, int to_version);
@@ -81,7 +81,10 @@ public:
         std::vector<uint8_t> value;
         bool result;
 
-        [[nodiscard]] bool execute(const std::vector<uint8_t> &data) const;
+        [[nodiscard]] bool is_data_test() const { return type == TEST_DATA || type == TEST_OR || type == TEST_AND || type == TEST_XOR; }
+        [[nodiscard]] bool get_data_offset(uint64_t size, uint64_t *data_offset) const;
+        [[nodiscard]] bool execute(const uint8_t *data) const;
+        [[nodiscard]] bool execute(uint64_t size) const;
         void print(FILE *fout) const;
         
     private:
@@ -97,11 +100,58 @@ public:
         Operation operation;
         std::vector<Test> tests;
         
-        [[nodiscard]] Hashes execute(const std::vector<uint8_t> &data) const;
+        [[nodiscard]] bool get_range(uint64_t size, uint64_t *start, uint64_t *end) const;
         void print(FILE *fout) const;
-        
+    };
+
+    /* Runs detectors on a file whose data is passed in blocks, as it is read for computing its hashes. */
+    class Execution {
+    public:
+        Execution(const std::unordered_map<size_t, DetectorPtr> &detectors, uint64_t size);
+
+        void update(const uint8_t *data, uint64_t length);
+        void end(File *file);
+
     private:
-        [[nodiscard]] Hashes compute_values(Operation operation, const std::vector<uint8_t> &data, uint64_t start, uint64_t length) const;
+        class TestData {
+        public:
+            TestData(const Test *test_, uint64_t offset_) : test(test_), offset(offset_), data(test_->length) { }
+
+            const Test *test;
+            uint64_t offset;
+            std::vector<uint8_t> data;
+        };
+
+        class RuleExecution {
+        public:
+            RuleExecution(const Rule *rule, uint64_t size);
+
+            bool possible; // range is valid and no test failed so far
+            Operation operation;
+            uint64_t start;
+            uint64_t end;
+            std::vector<TestData> pending_tests; // tests whose data hasn't been read completely
+            std::unique_ptr<Hashes> hashes;
+            std::unique_ptr<Hashes::Update> hashes_update;
+            uint8_t partial_unit[4]; // data of operation unit split between blocks
+            size_t partial_unit_length;
+
+            void update(const uint8_t *data, uint64_t length, uint64_t position, std::vector<uint8_t> *buffer);
+
+        private:
+            void hash(const uint8_t *data, uint64_t length, std::vector<uint8_t> *buffer);
+        };
+
+        class DetectorExecution {
+        public:
+            size_t id;
+            std::vector<RuleExecution> rules;
+        };
+
+        uint64_t size;
+        uint64_t position;
+        std::vector<DetectorExecution> detectors;
+        std::vector<uint8_t> buffer; // reused for data processed by rule operation
     };
     
 
@@ -117,7 +167,6 @@ public:
     static DetectorPtr parse(const std::string &filename);
     static DetectorPtr parse(ParserSource *parser_source);
 
-    [[nodiscard]] Hashes execute(const std::vector<uint8_t> &data) const;
     bool print(FILE *) const;
 
     static std::string file_test_type_name(TestType type);
@@ -126,12 +175,10 @@ public:
 
     static size_t get_id(const DetectorDescriptor &descriptor) { return detector_ids.get_id(descriptor); }
     static const DetectorDescriptor *get_descriptor(size_t id) { return detector_ids.get_descriptor(id); }
-    
-    // Returns true if new hashes were computed.
-    static bool compute_hashes(const std::vector<uint8_t> &data, File *file, const std::unordered_map<size_t, DetectorPtr> &detectors);
 
 private:
     static uint64_t operation_unit_size(Operation operation);
+    static void process(Operation operation, const uint8_t *data, uint8_t *processed_data, uint64_t length);
     static DetectorCollection detector_ids;
 };
 
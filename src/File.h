@@ -38,7 +38,7 @@
 
 class File : public FileData {
   public:
-    File() : FileData(), broken(false) {}
+    File() : FileData(), broken(false), data_verified(false) {}
 
     uint64_t get_size(size_t detector) const { return get_hashes(detector).size; }
     const Hashes& get_hashes(size_t detector) const;
@@ -52,6 +52,7 @@ class File : public FileData {
 
     std::string filename_extension;
     bool broken;
+    bool data_verified; // hashes were computed from the complete uncompressed data in this run, so it passed the CRC check
 
     std::unordered_map<size_t, Hashes> detector_hashes;
 
@@ -33,116 +33,61 @@
 
 #include "MemDB.h"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
 #include "Exception.h"
 
 std::unique_ptr<MemDB> memdb;
 
 bool MemDB::inited = false;
 
-#define INSERT_FILE_ARCHIVE_ID 1
-#define INSERT_FILE_FILE_TYPE 2
-#define INSERT_FILE_FILE_IDX 3
-#define INSERT_FILE_DETECTOR_ID 4
-#define INSERT_FILE_LOCATION 5
-#define INSERT_FILE_SIZE 6
-#define INSERT_FILE_HASHES 7
-
-std::unordered_map<MemDB::Statement, std::string> MemDB::queries = {
-    { DEC_FILE_IDX, "update file set file_idx=file_idx-1 where archive_id = :archive_id and file_type = :file_type and file_idx > :file_idx" },
-    { DELETE_FILE, "delete from file where archive_id = :archive_id and file_type = :file_type and file_idx = :file_idx" },
-    { INSERT_FILE, "insert into file (archive_id, file_type, file_idx, detector_id, location, size, crc, md5, sha1) values (:archive_id, :file_type, :file_idx, :detector_id, :location, :size, :crc, :md5, :sha1)" }
-};
-
-std::unordered_map<MemDB::ParameterizedStatement, std::string> MemDB::parameterized_queries = {
-    { QUERY_FILE, "select archive_id, file_idx, detector_id, location from file f where file_type = :file_type @SIZE@ @HASH@ order by location" }
-};
-
-const DB::DBFormat MemDB::format = {
-    0x1,
-    1,
-    "\
-create table file (\n\
-    archive_id integer,\n\
-    file_type integer,\n\
-    file_idx integer,\n\
-    detector_id integer,\n\
-    location integer not null,\n\
-    size integer,\n\
-    crc integer,\n\
-    md5 binary,\n\
-    sha1 binary\n\
-);\n\
-create index file_id on file (archive_id, file_type, file_idx);\n\
-create index file_location on file (location);\n\
-create index file_size on file (size);\n\
-create index file_crc on file (crc);\n\
-create index file_md5 on file (md5);\n\
-create index file_sha1 on file (sha1);\n",
-    {}
-};
-
-
-std::string MemDB::get_query(int name, bool parameterized) const {
-    if (parameterized) {
-        auto it = parameterized_queries.find(static_cast<ParameterizedStatement>(name));
-        if (it == parameterized_queries.end()) {
-            return "";
-        }
-        return it->second;
-    }
-    else {
-        auto it = queries.find(static_cast<Statement>(name));
-        if (it == queries.end()) {
-            return "";
-        }
-        return it->second;
-    }
-}
+#define INDEX_SIZE (Hashes::TYPE_MAX << 1)
+#define INDEX_MISSING (Hashes::TYPE_MAX << 2)
 
+static uint64_t hash_key(const Hashes &hashes, int type);
+static bool entry_matches(const Hashes &entry, const Hashes &query);
 
-void MemDB::ensure() {
-    const char *dbname;
 
+void MemDB::ensure() {
     if (inited) {
         if (memdb == nullptr) {
             throw Exception("can't initialize memdb");
         }
     }
 
-    if (getenv("CKMAME_DEBUG_MEMDB")) {
-	dbname = "memdb.sqlite3";
-    }
-    else {
-	dbname = ":memory:";
-    }
-
     inited = true;
 
-    memdb = nullptr;
-    memdb = std::make_unique<MemDB>(dbname);
+    memdb = std::make_unique<MemDB>();
 }
 
 
 void MemDB::delete_file(const ArchiveContents *archive, size_t index, bool adjust_idx) {
-    auto stmt = get_statement(DELETE_FILE);
-    
-    stmt->set_uint64("archive_id", archive->id);
-    stmt->set_int("file_type", archive->filetype);
-    stmt->set_uint64("file_idx", index);
-    
-    stmt->execute();
-
-    if (!adjust_idx) {
+    auto it = archive_entries.find(ArchiveKey(archive->id, archive->filetype));
+    if (it == archive_entries.end()) {
+        return;
+    }
+    auto &files = it->second;
+    if (index >= files.size()) {
         return;
     }
 
-    stmt = get_statement(DEC_FILE_IDX);
+    for (auto id : files[index]) {
+        remove_entry(id);
+    }
 
-    stmt->set_uint64("archive_id", archive->id);
-    stmt->set_int("file_type", archive->filetype);
-    stmt->set_int("file_idx", static_cast<int>(index));
+    if (!adjust_idx) {
+        files[index].clear();
+        return;
+    }
 
-    stmt->execute();
+    files.erase(files.begin() + static_cast<ssize_t>(index));
+    for (auto i = index; i < files.size(); i++) {
+        for (auto id : files[i]) {
+            entries[id].index = i;
+        }
+    }
 }
 
 
@@ -160,32 +105,10 @@ void MemDB::insert_file(const ArchiveContents *archive, size_t index) {
         return;
     }
 
-    auto stmt = get_statement(INSERT_FILE);
-    
-    stmt->reset();
-    
-    stmt->set_uint64("archive_id", archive->id);
-    stmt->set_int("file_type", archive->filetype);
-    stmt->set_int("location", archive->where);
-    stmt->set_uint64("file_idx", index);
-    stmt->set_uint64("detector_id", 0);
-    stmt->set_uint64("size", file.hashes.size, Hashes::SIZE_UNKNOWN);
-    stmt->set_hashes(file.hashes, true);
-    
-    stmt->execute();
+    add_entry(archive, index, 0, file.hashes);
 
     for (const auto &pair : file.detector_hashes) {
-        stmt->reset();
-        
-        stmt->set_uint64("archive_id", archive->id);
-        stmt->set_int("file_type", archive->filetype);
-        stmt->set_int("location", archive->where);
-        stmt->set_uint64("file_idx", index);
-        stmt->set_uint64("detector_id", pair.first);
-        stmt->set_uint64("size", pair.second.size, Hashes::SIZE_UNKNOWN);
-        stmt->set_hashes(pair.second, true);
-        
-        stmt->execute();
+        add_entry(archive, index, pair.first, pair.second);
     }
 }
 
@@ -197,27 +120,183 @@ void MemDB::update_file(const ArchiveContents *archive, size_t index) {
 
 
 std::vector<MemDB::FindResult> MemDB::find(filetype_t filetype, const FileData *file) {
-    auto stmt = get_statement(QUERY_FILE, file->hashes, file->is_size_known());
-    
+    const auto &hashes = file->hashes;
+
+    /* use the key with the fewest candidates */
+    std::vector<const Posting *> candidates;
+    auto candidates_size = std::numeric_limits<size_t>::max();
+
+    auto consider = [&](const std::vector<const Posting *> &postings) {
+        size_t size = 0;
+        for (auto posting : postings) {
+            if (posting != nullptr) {
+                size += posting->size();
+            }
+        }
+        if (size < candidates_size) {
+            candidates = postings;
+            candidates_size = size;
+        }
+    };
+
     if (file->is_size_known()) {
-        stmt->set_uint64("size", file->hashes.size);
+        consider({get_posting(IndexKey(filetype, INDEX_SIZE, hashes.size))});
+    }
+    for (auto type = 1; type <= Hashes::TYPE_MAX; type <<= 1) {
+        if (hashes.has_type(type)) {
+            consider({get_posting(IndexKey(filetype, type, hash_key(hashes, type))), get_posting(IndexKey(filetype, type | INDEX_MISSING, 0))});
+        }
     }
 
-    stmt->set_int("file_type", filetype);
-    stmt->set_hashes(file->hashes, 0);
+    std::vector<uint64_t> ids;
+    if (candidates_size == std::numeric_limits<size_t>::max()) {
+        for (const auto &pair : entries) {
+            if (pair.second.filetype == filetype) {
+                ids.push_back(pair.first);
+            }
+        }
+    }
+    else {
+        ids.reserve(candidates_size);
+        for (auto posting : candidates) {
+            if (posting != nullptr) {
+                ids.insert(ids.end(), posting->begin(), posting->end());
+            }
+        }
+    }
+    std::sort(ids.begin(), ids.end());
 
     std::vector<FindResult> results;
-    
-    while (stmt->step()) {
+
+    for (auto id : ids) {
+        const auto &entry = entries[id];
+
+        if (file->is_size_known() && entry.hashes.size != hashes.size) {
+            continue;
+        }
+        if (!entry_matches(entry.hashes, hashes)) {
+            continue;
+        }
+
         FindResult result;
-        
-        result.archive_id = stmt->get_uint64("archive_id");
-        result.index = stmt->get_uint64("file_idx");
-        result.detector_id = stmt->get_uint64("detector_id");
-        result.location = static_cast<where_t>(stmt->get_int("location"));
-        
+
+        result.archive_id = entry.archive_id;
+        result.index = entry.index;
+        result.detector_id = entry.detector_id;
+        result.location = entry.location;
+
         results.push_back(result);
     }
-    
+
+    std::stable_sort(results.begin(), results.end(), [](const FindResult &a, const FindResult &b) { return a.location < b.location; });
+
     return results;
 }
+
+
+void MemDB::add_entry(const ArchiveContents *archive, size_t file_index, size_t detector_id, const Hashes &hashes) {
+    auto id = next_entry_id++;
+    auto &entry = entries[id];
+
+    entry.archive_id = archive->id;
+    entry.filetype = archive->filetype;
+    entry.index = file_index;
+    entry.detector_id = detector_id;
+    entry.location = archive->where;
+    entry.hashes = hashes;
+
+    for (const auto &key : index_keys(entry)) {
+        index[key].insert(id);
+    }
+
+    auto &files = archive_entries[ArchiveKey(archive->id, archive->filetype)];
+    if (files.size() <= file_index) {
+        files.resize(file_index + 1);
+    }
+    files[file_index].push_back(id);
+}
+
+
+void MemDB::remove_entry(uint64_t id) {
+    auto it = entries.find(id);
+    if (it == entries.end()) {
+        return;
+    }
+
+    for (const auto &key : index_keys(it->second)) {
+        auto posting = index.find(key);
+        if (posting != index.end()) {
+            posting->second.erase(id);
+            if (posting->second.empty()) {
+                index.erase(posting);
+            }
+        }
+    }
+
+    entries.erase(it);
+}
+
+
+const MemDB::Posting *MemDB::get_posting(const IndexKey &key) const {
+    auto it = index.find(key);
+    if (it == index.end()) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+
+std::vector<MemDB::IndexKey> MemDB::index_keys(const Entry &entry) {
+    std::vector<IndexKey> keys;
+
+    if (entry.hashes.has_size()) {
+        keys.emplace_back(entry.filetype, INDEX_SIZE, entry.hashes.size);
+    }
+    for (auto type = 1; type <= Hashes::TYPE_MAX; type <<= 1) {
+        if (entry.hashes.has_type(type)) {
+            keys.emplace_back(entry.filetype, type, hash_key(entry.hashes, type));
+        }
+        else {
+            keys.emplace_back(entry.filetype, type | INDEX_MISSING, 0);
+        }
+    }
+
+    return keys;
+}
+
+
+/* Value to index hash of type by; for md5 and sha1, the first 8 bytes of the digest. */
+static uint64_t hash_key(const Hashes &hashes, int type) {
+    uint64_t value = 0;
+
+    switch (type) {
+        case Hashes::TYPE_CRC:
+            value = hashes.crc;
+            break;
+
+        case Hashes::TYPE_MD5:
+            memcpy(&value, hashes.md5.data(), sizeof(value));
+            break;
+
+        case Hashes::TYPE_SHA1:
+            memcpy(&value, hashes.sha1.data(), sizeof(value));
+            break;
+    }
+
+    return value;
+}
+
+
+/* Hashes of query that entry also has must be equal. */
+static bool entry_matches(const Hashes &entry, const Hashes &query) {
+    if (query.has_type(Hashes::TYPE_CRC) && entry.has_type(Hashes::TYPE_CRC) && entry.crc != query.crc) {
+        return false;
+    }
+    if (query.has_type(Hashes::TYPE_MD5) && entry.has_type(Hashes::TYPE_MD5) && entry.md5 != query.md5) {
+        return false;
+    }
+    if (query.has_type(Hashes::TYPE_SHA1) && entry.has_type(Hashes::TYPE_SHA1) && entry.sha1 != query.sha1) {
+        return false;
+    }
+    return true;
+}
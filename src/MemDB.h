@@ -2,8 +2,8 @@
 #define HAD_MEMDB_H
 
 /*
-  memdb.h -- in-memory sqlite3 db
-  Copyright (C) 2007-2020 Dieter Baron and Thomas Klausner
+  MemDB.h -- in-memory index of files in archives
+  Copyright (C) 2007-2022 Dieter Baron and Thomas Klausner
 
   This file is part of ckmame, a program to check rom sets for MAME.
   The authors can be contacted at <ckmame@nih.at>
@@ -35,24 +35,14 @@
 */
 
 #include <memory>
-#include <optional>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "Archive.h"
-#include "DB.h"
 
-class MemDB: public DB {
+class MemDB {
 public:
-    enum Statement {
-        DEC_FILE_IDX,
-        DELETE_FILE,
-        INSERT_FILE,
-        UPDATE_FILE
-    };
-    enum ParameterizedStatement {
-        QUERY_FILE
-    };
-
     class FindResult {
     public:
         uint64_t archive_id;
@@ -60,11 +50,8 @@ public:
         size_t detector_id;
         where_t location;
     };
-    
-    explicit MemDB(const std::string &name) : DB(format, name, DBH_NEW) { }
-    ~MemDB() override = default;
-    
-    static const DBFormat format;
+
+    MemDB() : next_entry_id(0) { }
 
     static void ensure();
 
@@ -75,17 +62,64 @@ public:
 
     std::vector<FindResult> find(filetype_t filetype, const FileData *file);
 
-protected:
-    std::string get_query(int name, bool parameterized) const override;
-
 private:
-    DBStatement *get_statement(Statement name) { return get_statement_internal(name); }
-    DBStatement *get_statement(ParameterizedStatement name, const Hashes &hashes, bool have_size) { return get_statement_internal(name, hashes, have_size); }
-    
-    static std::unordered_map<Statement, std::string> queries;
-    static std::unordered_map<ParameterizedStatement, std::string> parameterized_queries;
+    class ArchiveKey {
+    public:
+        ArchiveKey(uint64_t archive_id_, filetype_t filetype_) : archive_id(archive_id_), filetype(filetype_) { }
+
+        uint64_t archive_id;
+        filetype_t filetype;
+
+        bool operator==(const ArchiveKey &other) const { return archive_id == other.archive_id && filetype == other.filetype; }
+
+        class Hash {
+        public:
+            std::size_t operator()(const ArchiveKey &k) const { return std::hash<uint64_t>()(k.archive_id) ^ std::hash<int>()(k.filetype); }
+        };
+    };
+
+    class IndexKey {
+    public:
+        IndexKey(filetype_t filetype_, int type_, uint64_t value_) : filetype(filetype_), type(type_), value(value_) { }
+
+        filetype_t filetype;
+        int type;
+        uint64_t value;
+
+        bool operator==(const IndexKey &other) const { return filetype == other.filetype && type == other.type && value == other.value; }
+
+        class Hash {
+        public:
+            std::size_t operator()(const IndexKey &k) const { return std::hash<uint64_t>()(k.value) ^ (std::hash<int>()(k.type) << 4) ^ std::hash<int>()(k.filetype); }
+        };
+    };
+
+    class Entry {
+    public:
+        uint64_t archive_id;
+        filetype_t filetype;
+        size_t index;
+        size_t detector_id;
+        where_t location;
+        Hashes hashes;
+    };
+
+    typedef std::unordered_set<uint64_t> Posting;
+
+    /* entry ids are assigned in increasing order, so they also record insertion order */
+    uint64_t next_entry_id;
+    std::unordered_map<uint64_t, Entry> entries;
+    /* entries of each file, by archive and file index */
+    std::unordered_map<ArchiveKey, std::vector<std::vector<uint64_t>>, ArchiveKey::Hash> archive_entries;
+    /* entries by size and by each hash; entries missing a hash type are listed under its missing key */
+    std::unordered_map<IndexKey, Posting, IndexKey::Hash> index;
 
     static bool inited;
+
+    void add_entry(const ArchiveContents *archive, size_t file_index, size_t detector_id, const Hashes &hashes);
+    void remove_entry(uint64_t id);
+    const Posting *get_posting(const IndexKey &key) const;
+    static std::vector<IndexKey> index_keys(const Entry &entry);
 };
 
 extern std::unique_ptr<MemDB> memdb;
@@ -44,6 +44,7 @@ class MkMameDB : public Command {
     void global_setup(const ParsedCommandline& commandline) override;
     bool execute(const std::vector<std::string>& arguments) override;
     bool global_cleanup() override;
+    [[nodiscard]] bool updates_dat_directories() const override { return true; }
 
   private:
     std::string dbname, dbname_real;
@@ -5,6 +5,7 @@
 #include "Output.h"
 
 #include "globals.h"
+#include "util.h"
 
 Output::Output() :
     first_header(true),
@@ -14,6 +15,25 @@ Output::Output() :
     db(nullptr) {
 }
 
+static thread_local Output::Capture *current_capture = nullptr;
+
+Output::Capture::Capture() :
+    file_infos({FileInfo("", "")}),
+    previous(current_capture) {
+    current_capture = this;
+}
+
+
+Output::Capture::~Capture() {
+    current_capture = previous;
+}
+
+
+std::vector<Output::FileInfo> &Output::current_file_infos() {
+    return current_capture != nullptr ? current_capture->file_infos : file_infos;
+}
+
+
 void Output::set_header(std::string new_header) {
     header = std::move(new_header);
     header_done = false;
@@ -28,13 +48,13 @@ void Output::set_subheader(std::string new_subheader) {
 
 
 void Output::set_error_archive(std::string new_archive_name, std::string new_file_name) {
-    file_infos.back().archive_name = std::move(new_archive_name);
+    current_file_infos().back().archive_name = std::move(new_archive_name);
     set_error_file(std::move(new_file_name));
 }
 
 
 void Output::set_error_file(std::string new_file_name) {
-    file_infos.back().file_name = std::move(new_file_name);
+    current_file_infos().back().file_name = std::move(new_file_name);
 }
 
 
@@ -120,7 +140,7 @@ void Output::error_error_code(const std::error_code &ec, const char *fmt, ...) {
 void Output::archive_error(const char *fmt, ...) {
     va_list va;
     va_start(va, fmt);
-    print_error_v(fmt, va, file_infos.back().archive_name);
+    print_error_v(fmt, va, current_file_infos().back().archive_name);
     va_end(va);
 }
 
@@ -128,7 +148,7 @@ void Output::archive_error(const char *fmt, ...) {
 void Output::archive_error_database(const char *fmt, ...){
     va_list va;
     va_start(va, fmt);
-    print_error_v(fmt, va, file_infos.back().archive_name, postfix_database());
+    print_error_v(fmt, va, current_file_infos().back().archive_name, postfix_database());
     va_end(va);
 }
 
@@ -136,7 +156,7 @@ void Output::archive_error_database(const char *fmt, ...){
 void Output::archive_error_system(const char *fmt, ...){
     va_list va;
     va_start(va, fmt);
-    print_error_v(fmt, va, file_infos.back().archive_name, postfix_system());
+    print_error_v(fmt, va, current_file_infos().back().archive_name, postfix_system());
     va_end(va);
 }
 
@@ -144,7 +164,7 @@ void Output::archive_error_system(const char *fmt, ...){
 void Output::archive_error_error_code(const std::error_code &ec, const char *fmt, ...) {
     va_list va;
     va_start(va, fmt);
-    print_error_v(fmt, va, file_infos.back().archive_name, ec.message());
+    print_error_v(fmt, va, current_file_infos().back().archive_name, ec.message());
     va_end(va);
 }
 
@@ -176,7 +196,7 @@ void Output::archive_file_error_error_code(const std::error_code &ec, const char
 void Output::file_error(const char *fmt, ...) {
     va_list va;
     va_start(va, fmt);
-    print_error_v(fmt, va, file_infos.back().file_name);
+    print_error_v(fmt, va, current_file_infos().back().file_name);
     va_end(va);
 }
 
@@ -184,7 +204,7 @@ void Output::file_error(const char *fmt, ...) {
 void Output::file_error_database(const char *fmt, ...){
     va_list va;
     va_start(va, fmt);
-    print_error_v(fmt, va, file_infos.back().file_name, postfix_database());
+    print_error_v(fmt, va, current_file_infos().back().file_name, postfix_database());
     va_end(va);
 }
 
@@ -192,7 +212,7 @@ void Output::file_error_database(const char *fmt, ...){
 void Output::file_error_system(const char *fmt, ...){
     va_list va;
     va_start(va, fmt);
-    print_error_v(fmt, va, file_infos.back().file_name, postfix_system());
+    print_error_v(fmt, va, current_file_infos().back().file_name, postfix_system());
     va_end(va);
 }
 
@@ -200,7 +220,7 @@ void Output::file_error_system(const char *fmt, ...){
 void Output::archive_file_error_system(const char *fmt, ...){
     va_list va;
     va_start(va, fmt);
-    print_error_v(fmt, va, file_infos.back().file_name, postfix_system());
+    print_error_v(fmt, va, current_file_infos().back().file_name, postfix_system());
     va_end(va);
 }
 
@@ -208,7 +228,7 @@ void Output::archive_file_error_system(const char *fmt, ...){
 void Output::file_error_error_code(const std::error_code &ec, const char *fmt, ...) {
     va_list va;
     va_start(va, fmt);
-    print_error_v(fmt, va, file_infos.back().file_name, ec.message());
+    print_error_v(fmt, va, current_file_infos().back().file_name, ec.message());
     va_end(va);
 }
 
@@ -247,8 +267,8 @@ void Output::line_error_error_code(size_t line_number, const std::error_code &ec
 
 
 std::string Output::prefix_archive_file() {
-    if (!file_infos.back().archive_name.empty() && !file_infos.back().file_name.empty()) {
-	return file_infos.back().archive_name + "(" + file_infos.back().file_name + ")";
+    if (!current_file_infos().back().archive_name.empty() && !current_file_infos().back().file_name.empty()) {
+	return current_file_infos().back().archive_name + "(" + current_file_infos().back().file_name + ")";
     }
     else {
 	return "";
@@ -268,7 +288,7 @@ std::string Output::postfix_database() {
 
 std::string  Output::prefix_line(size_t line_number) {
     // TODO: also use archive_name
-    return file_infos.back().file_name + ":" + std::to_string(line_number);
+    return current_file_infos().back().file_name + ":" + std::to_string(line_number);
 }
 
 std::string Output::postfix_system() {
@@ -282,6 +302,20 @@ std::string Output::postfix_system() {
 
 void Output::print_error_v(const char *fmt, va_list va, const std::string &prefix, const std::string &postfix) {
     // Don't print header to stdout for error messages printed to stderr.
+
+    if (current_capture != nullptr) {
+        auto &messages = current_capture->messages;
+        messages += std::string(getprogname()) + ": ";
+        if (!prefix.empty()) {
+            messages += prefix + ": ";
+        }
+        messages += string_format_v(fmt, va);
+        if (!postfix.empty()) {
+            messages += ": " + postfix;
+        }
+        messages += "\n";
+        return;
+    }
     
     fprintf(stderr, "%s: ", getprogname());
     if (!prefix.empty()) {
@@ -294,17 +328,17 @@ void Output::print_error_v(const char *fmt, va_list va, const std::string &prefi
     fprintf(stderr, "\n");
 }
 void Output::push_error_archive(std::string archive_name, std::string file_name) {
-    file_infos.emplace_back(FileInfo(std::move(archive_name), std::move(file_name)));
+    current_file_infos().emplace_back(FileInfo(std::move(archive_name), std::move(file_name)));
 }
 
 
 void Output::push_error_file(std::string file_name) {
-    file_infos.emplace_back(FileInfo("", std::move(file_name)));
+    current_file_infos().emplace_back(FileInfo("", std::move(file_name)));
 }
 
 
 void Output::pop_error_file_info() {
-    if (file_infos.size() > 1) {
-        file_infos.pop_back();
+    if (current_file_infos().size() > 1) {
+        current_file_infos().pop_back();
     }
 }
@@ -7,6 +7,7 @@
 
 #include <string>
 #include <system_error>
+#include <vector>
 
 #include "DB.h"
 #include "printf_like.h"
@@ -16,6 +17,7 @@ class Output {
     Output();
 
     void set_header(std::string header);
+    void restart_headers() { first_header = true; } // don't separate next header from previous output
     void set_subheader(std::string subheader);
     void message(const std::string& string) { message("%s", string.c_str()); }
     void message(const char* fmt, ...) PRINTF_LIKE(2, 3);
@@ -64,6 +66,22 @@ class Output {
         std::string file_name;
     };
 
+  public:
+    /* While a Capture exists, error messages of the thread that created it are collected in it instead of being printed. */
+    class Capture {
+      public:
+        Capture();
+        ~Capture();
+
+        std::string messages;
+
+      private:
+        friend class Output;
+        std::vector<FileInfo> file_infos;
+        Capture *previous; // capture active when this one was created, restored when it ends
+    };
+
+  private:
     std::string header;
     std::string subheader;
     bool first_header;
@@ -73,6 +91,7 @@ class Output {
     std::vector<FileInfo> file_infos;
     DB* db;
 
+    std::vector<FileInfo> &current_file_infos();
     void print_header();
 
     void print_message_v(const char* fmt, va_list va);
@@ -48,6 +48,8 @@ class OutputContext;
 typedef std::shared_ptr<OutputContext> OutputContextPtr;
 
 #define OUTPUT_FL_RUNTEST  1
+#define OUTPUT_FL_IMAGE    2
+#define OUTPUT_FL_UPDATE   4
 
 class OutputContext {
 public:
@@ -0,0 +1,74 @@
+/*
+OutputContextBuffer.cc -- record parsed dat for later replay
+Copyright (C) 2022 Dieter Baron and Thomas Klausner
+
+This file is part of ckmame, a program to check rom sets for MAME.
+The authors can be contacted at <ckmame@nih.at>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in
+   the documentation and/or other materials provided with the
+   distribution.
+3. The name of the author may not be used to endorse or promote
+   products derived from this software without specific prior
+   written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "OutputContextBuffer.h"
+
+bool OutputContextBuffer::detector(Detector *detector) {
+    entries.emplace_back(std::make_shared<Detector>(*detector));
+    return true;
+}
+
+
+bool OutputContextBuffer::game(GamePtr game, const std::string &original_name) {
+    entries.emplace_back(std::move(game), original_name);
+    return true;
+}
+
+
+bool OutputContextBuffer::header(DatEntry *dat) {
+    entries.emplace_back(std::make_shared<DatEntry>(*dat));
+    return true;
+}
+
+
+bool OutputContextBuffer::replay(OutputContext *out) const {
+    for (const auto &entry : entries) {
+        auto ok = true;
+
+        if (entry.dat) {
+            ok = out->header(entry.dat.get());
+        }
+        else if (entry.detector) {
+            ok = out->detector(entry.detector.get());
+        }
+        else {
+            ok = out->game(entry.game, entry.original_name);
+        }
+
+        if (!ok) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef HAD_OUTPUT_CONTEXT_BUFFER_H
+#define HAD_OUTPUT_CONTEXT_BUFFER_H
+
+/*
+OutputContextBuffer.h -- record parsed dat for later replay
+Copyright (C) 2022 Dieter Baron and Thomas Klausner
+
+This file is part of ckmame, a program to check rom sets for MAME.
+The authors can be contacted at <ckmame@nih.at>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in
+   the documentation and/or other materials provided with the
+   distribution.
+3. The name of the author may not be used to endorse or promote
+   products derived from this software without specific prior
+   written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <vector>
+
+#include "OutputContext.h"
+
+/* Records header, detector, and games in the order they were output, to be written to another output context later. */
+class OutputContextBuffer : public OutputContext {
+  public:
+    bool close() override { return true; }
+    bool detector(Detector *detector) override;
+    bool game(GamePtr game, const std::string &original_name) override;
+    bool header(DatEntry *dat) override;
+
+    bool replay(OutputContext *out) const;
+
+  private:
+    class Entry {
+      public:
+        Entry(std::shared_ptr<DatEntry> dat_) : dat(std::move(dat_)) { }
+        Entry(DetectorPtr detector_) : detector(std::move(detector_)) { }
+        Entry(GamePtr game_, std::string original_name_) : game(std::move(game_)), original_name(std::move(original_name_)) { }
+
+        std::shared_ptr<DatEntry> dat;
+        DetectorPtr detector;
+        GamePtr game;
+        std::string original_name;
+    };
+
+    std::vector<Entry> entries;
+};
+
+#endif // HAD_OUTPUT_CONTEXT_BUFFER_H
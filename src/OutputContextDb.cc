@@ -35,9 +35,12 @@
 
 #include <algorithm>
 #include <filesystem>
+#include <unordered_set>
 
+#include "Exception.h"
 #include "file_util.h"
 #include "globals.h"
+#include "Performance.h"
 
 
 struct fbh_context {
@@ -48,7 +51,10 @@ struct fbh_context {
 
 OutputContextDb::OutputContextDb(const std::string &dbname, int flags) :
 									 file_name(dbname),
-									 ok(true) {
+									 ok(true),
+									 write_image(flags & OUTPUT_FL_IMAGE),
+									 update(flags & OUTPUT_FL_UPDATE),
+									 dat_no(0) {
     temp_file_name = file_name + "-mkmamedb";
     if (configuration.use_temp_directory) {
 	auto tmpdir = getenv("TMPDIR");
@@ -58,7 +64,28 @@ OutputContextDb::OutputContextDb(const std::string &dbname, int flags) :
     }
     temp_file_name = make_unique_name(temp_file_name, "");
 
-    db = std::make_unique<RomDB>(temp_file_name, DBH_NEW);
+    if (update) {
+	/* work on a copy, so the database stays intact if the update fails */
+	std::filesystem::copy_file(file_name, temp_file_name);
+	try {
+	    db = std::make_unique<RomDB>(temp_file_name, DBH_WRITE);
+	    if (db->has_detector()) {
+		throw Exception("can't update database using detector");
+	    }
+	}
+	catch (...) {
+	    db = nullptr;
+	    std::filesystem::remove(temp_file_name);
+	    throw;
+	}
+	dat = db->read_dat();
+    }
+    else {
+	db = std::make_unique<RomDB>(temp_file_name, DBH_NEW);
+    }
+
+    /* The database is a temporary file until it is complete, so write it in one transaction. */
+    db->begin_transaction();
 }
 
 
@@ -76,7 +103,7 @@ void OutputContextDb::familymeeting(Game *parent, Game *child) {
         child->cloneof[1] = parent->cloneof[0];
     }
     
-    auto grand_parent = child->cloneof[1].empty() ? nullptr : db->read_game(child->cloneof[1]);
+    auto grand_parent = child->cloneof[1].empty() ? nullptr : find_game(child->cloneof[1]);
 
     /* look for files in parent */
     for (size_t ft = 0; ft < TYPE_MAX; ft++) {
@@ -104,41 +131,52 @@ void OutputContextDb::familymeeting(Game *parent, Game *child) {
 }
 
 
+/* Returns game name from current dat or database. */
+GamePtr OutputContextDb::find_game(const std::string &name) {
+    auto it = staged_games_by_name.find(name);
+    if (it != staged_games_by_name.end()) {
+        return it->second;
+    }
+
+    return db->read_game(name);
+}
+
+
 bool OutputContextDb::handle_lost() {
     while (!lost_children.empty()) {
         for (size_t i = 0; i < lost_children.size(); i++) {
-            /* get current lost child from database, get parent,
+            /* get current lost child, get parent,
              look if parent is still lost, if not, do child */
-            auto child = db->read_game(lost_children[i]);
+            auto child = find_game(lost_children[i]);
             if (!child) {
-                output.error("internal database error: child %s not in database", lost_children[i].c_str());
+                output.error("internal error: lost child %s not found", lost_children[i].c_str());
                 return false;
             }
             
             bool is_lost = true;
 
             auto parent_name = get_game_name(child->cloneof[0]);
-            auto parent = db->read_game(parent_name);
+            auto parent = find_game(parent_name);
             if (!parent) {
                 output.error("inconsistency: %s has non-existent parent %s", child->name.c_str(), parent_name.c_str());
                 
-                /* remove non-existent cloneof */
+                /* remove non-existent cloneof, but remember it for updates */
+                missing_parents.emplace_back(child->name, parent_name);
                 child->cloneof[0] = "";
-                db->update_game_parent(child.get());
                 is_lost = false;
             }
+            else if (update && parent->dat_no != dat_no) {
+                /* family spans dats, can't be updated in place */
+                return false;
+            }
             else if (!lost(parent.get())) {
                 /* parent found */
-                if (child->cloneof[0] != parent_name) {
-                    child->cloneof[0] = parent_name;
-                    db->update_game_parent(child.get());
-                }
+                child->cloneof[0] = parent_name;
                 familymeeting(parent.get(), child.get());
                 is_lost = false;
             }
             
             if (!is_lost) {
-                db->update_file_location(child.get());
                 lost_children.erase(lost_children.begin() + static_cast<long>(i));
             }
         }
@@ -167,13 +205,31 @@ bool OutputContextDb::close() {
         if (!handle_lost()) {
             ok = false;
         }
+        write_staged_games();
 
-        db->init2();
+        if (!update) {
+            /* creating indexes after all rows are written is faster than updating them for every row */
+            auto measurement = Performance::Measurement(&performance, "create ROM database indexes");
+            db->init2();
+        }
+        db->commit_transaction();
 
         db = nullptr;
 
 	if (ok) { // TODO: and no previous errors
 	    rename_or_move(temp_file_name, file_name);
+
+	    /* an existing image would be out of date, so refresh it */
+	    std::error_code ec;
+	    if (write_image || std::filesystem::exists(RomDBImage::file_name_for(file_name), ec)) {
+		try {
+		    RomDBImage::write(file_name);
+		}
+		catch (Exception &e) {
+		    output.error("can't write image of '%s': %s", file_name.c_str(), e.what());
+		    ok = false;
+		}
+	    }
 	}
 	else {
 	    std::filesystem::remove(temp_file_name);
@@ -185,37 +241,72 @@ bool OutputContextDb::close() {
 
 
 bool OutputContextDb::detector(Detector *detector) {
+    if (update) {
+        ok = false;
+        return false;
+    }
+    detector->id = Detector::get_id(DetectorDescriptor(detector));
+    if (detector_id) {
+        if (*detector_id == detector->id) {
+            /* several dats use the same detector, store it only once */
+            return true;
+        }
+        output.error("can't use detector '%s', database already uses a different one", detector->name.c_str());
+        ok = false;
+        return false;
+    }
     db->write_detector(*detector);
+    detector_id = detector->id;
 
     return true;
 }
 
 
 bool OutputContextDb::game(GamePtr game, const std::string &original_name) {
+    if (update && missing_parents_of_other_dats.find(game->name) != missing_parents_of_other_dats.end()) {
+        /* game would have become parent of game from other dat */
+        ok = false;
+        return false;
+    }
     if (!original_name.empty()) {
         renamed_games[original_name] = game->name;
     }
-    auto g2 = db->read_game(game->name);
+    auto g2 = find_game(game->name);
 
     if (g2) {
+	if (update && g2->dat_no != dat_no) {
+	    /* name depends on games from other dats */
+	    ok = false;
+	    return false;
+	}
 	std::string name;
 	size_t n = 1;
 	while (true) {
 	    name = game->name + " (" + std::to_string(n) + ")";
-	    if (db->read_game(name) == nullptr) {
+	    auto g3 = find_game(name);
+	    if (g3 == nullptr) {
 		break;
 	    }
+	    if (update && g3->dat_no != dat_no) {
+		ok = false;
+		return false;
+	    }
 	    n += 1;
 	}
 	output.error("warning: duplicate game '%s', renamed to '%s'", game->name.c_str(), name.c_str());
 	game->name = name;
     }
 
-    game->dat_no = static_cast<unsigned int>(dat.size() - 1);
+    game->dat_no = static_cast<unsigned int>(dat_no);
 
     if (!game->cloneof[0].empty()) {
         auto parent_name = get_game_name(game->cloneof[0]);
-        auto parent = db->read_game(parent_name);
+        auto parent = find_game(parent_name);
+        if (update && parent && parent->dat_no != dat_no) {
+            /* family spans dats, can't be updated in place */
+            ok = false;
+            return false;
+        }
         if (!parent || lost(parent.get())) {
             lost_children.push_back(game->name);
         }
@@ -226,7 +317,8 @@ bool OutputContextDb::game(GamePtr game, const std::string &original_name) {
         }
     }
 
-    db->write_game(game.get());
+    staged_games.push_back(game);
+    staged_games_by_name[game->name] = game;
 
     return true;
 }
@@ -234,13 +326,80 @@ bool OutputContextDb::game(GamePtr game, const std::string &original_name) {
 
 bool OutputContextDb::header(DatEntry *entry) {
     handle_lost(); // from previous dat
+    write_staged_games();
 
-    dat.push_back(*entry);
+    if (update) {
+        dat[dat_no] = *entry;
+    }
+    else {
+        dat.push_back(*entry);
+        dat_no = dat.size() - 1;
+    }
  
     return true;
 }
 
 
+/* Remove games of dat index, which is parsed again next. Fails if they are related to games from other dats. */
+bool OutputContextDb::replace_dat(size_t index) {
+    if (!update || index >= dat.size() || !handle_lost()) {
+        return false;
+    }
+    write_staged_games();
+
+    auto game_dats = db->read_game_dats();
+    auto parents = db->read_parents();
+
+    std::unordered_set<std::string> names;
+    for (const auto &pair : game_dats) {
+        if (pair.second == index) {
+            names.insert(pair.first);
+        }
+    }
+
+    for (const auto &pair : game_dats) {
+        auto &name = pair.first;
+        if (pair.second == index) {
+            continue;
+        }
+
+        /* clone of game from this dat */
+        auto it = parents.find(name);
+        if (it != parents.end() && names.find(it->second) != names.end()) {
+            return false;
+        }
+
+        /* possibly renamed because of game from this dat */
+        auto suffix = name.rfind(" (");
+        if (suffix != std::string::npos && name.back() == ')' && names.find(name.substr(0, suffix)) != names.end()) {
+            return false;
+        }
+    }
+
+    auto missing_parents = db->read_missing_parents();
+    if (missing_parents.find("") != missing_parents.end()) {
+        /* migrated from a version that didn't record missing parents */
+        return false;
+    }
+
+    /* parents are only looked up in earlier dats, so only games of later dats could get one from this dat */
+    missing_parents_of_other_dats.clear();
+    for (const auto &pair : missing_parents) {
+        auto it = game_dats.find(pair.first);
+        if (it != game_dats.end() && it->second > index) {
+            missing_parents_of_other_dats.insert(pair.second);
+        }
+    }
+
+    for (const auto &name : names) {
+        db->delete_game(name);
+    }
+    dat_no = index;
+
+    return true;
+}
+
+
 std::string OutputContextDb::get_game_name(const std::string &original_name) {
     auto it = renamed_games.find(original_name);
     if (it == renamed_games.end()) {
@@ -250,3 +409,25 @@ std::string OutputContextDb::get_game_name(const std::string &original_name) {
         return it->second;
     }
 }
+
+
+void OutputContextDb::write_staged_games() {
+    auto measurement = Performance::Measurement(&performance, "write ROM database rows");
+
+    for (const auto &game : staged_games) {
+        db->write_game(game.get());
+
+        measurement.add(1);
+        for (const auto &files : game->files) {
+            measurement.add(files.size());
+        }
+    }
+
+    staged_games.clear();
+    staged_games_by_name.clear();
+
+    for (const auto &pair : missing_parents) {
+        db->write_missing_parent(pair.first, pair.second);
+    }
+    missing_parents.clear();
+}
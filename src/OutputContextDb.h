@@ -34,6 +34,9 @@
   IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <optional>
+#include <unordered_set>
+
 #include "OutputContext.h"
 #include "RomDB.h"
 
@@ -49,6 +52,8 @@ public:
     bool header(DatEntry *dat) override;
     void error_occurred() override { ok = false; }
 
+    bool replace_dat(size_t index);
+
 private:
     std::string file_name;
     std::string temp_file_name;
@@ -59,12 +64,29 @@ private:
 
     std::vector<std::string> lost_children;
 
+    /* games of current dat whose parent doesn't exist, with the parent's name */
+    std::vector<std::pair<std::string, std::string>> missing_parents;
+    /* names of parents that don't exist but are referenced by games of other dats, when updating */
+    std::unordered_set<std::string> missing_parents_of_other_dats;
+
+    /* games of current dat, written once it is complete and parents are resolved */
+    std::vector<GamePtr> staged_games;
+    std::unordered_map<std::string, GamePtr> staged_games_by_name;
+
+    /* id of the detector written to the database, if any */
+    std::optional<size_t> detector_id;
+
     bool ok;
+    bool write_image;
+    bool update;
+    size_t dat_no;
     
     void familymeeting(Game *parent, Game *child);
+    GamePtr find_game(const std::string &name);
     std::string get_game_name(const std::string& original_name);
     bool handle_lost();
     bool lost(Game *);
+    void write_staged_games();
 
     std::unordered_map<std::string, std::string> renamed_games;
 };
@@ -52,6 +52,8 @@ static const std::string unicode_bom = "\xEF\xBB\xBF";
 
 std::unordered_map<std::string, Parser::Format> Parser::format_start = {
     {"<?xml ",      XML       },
+    {std::string("\xFF\xFE<\0", 4), XML}, /* UTF-16 little endian */
+    {std::string("\xFE\xFF\0<", 4), XML}, /* UTF-16 big endian */
     {"BEGIN",       CLRMAMEPRO},
     {"[CREDITS]",   ROMCENTER },
     {"[DAT]",       ROMCENTER },
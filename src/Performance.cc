@@ -0,0 +1,74 @@
+/*
+Performance.cc -- collect timing of bulk operations
+Copyright (C) 2022 Dieter Baron and Thomas Klausner
+
+This file is part of ckmame, a program to check rom sets for MAME.
+The authors can be contacted at <ckmame@nih.at>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in
+   the documentation and/or other materials provided with the
+   distribution.
+3. The name of the author may not be used to endorse or promote
+   products derived from this software without specific prior
+   written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Performance.h"
+
+#include <cinttypes>
+
+#include "globals.h"
+
+Performance performance;
+
+
+void Performance::add(const std::string &name, uint64_t count, std::chrono::steady_clock::duration duration) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto &counter = counters[name];
+    counter.count += count;
+    counter.duration += duration;
+}
+
+
+void Performance::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    counters.clear();
+}
+
+
+void Performance::print() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (const auto &pair : counters) {
+        auto seconds = std::chrono::duration<double>(pair.second.duration).count();
+        if (pair.second.count > 0 && seconds > 0) {
+            output.message("%s: %" PRIu64 " in %.3fs (%.0f/s)", pair.first.c_str(), pair.second.count, seconds, static_cast<double>(pair.second.count) / seconds);
+        }
+        else if (pair.second.count > 0) {
+            output.message("%s: %" PRIu64, pair.first.c_str(), pair.second.count);
+        }
+        else {
+            output.message("%s: %.3fs", pair.first.c_str(), seconds);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef HAD_PERFORMANCE_H
+#define HAD_PERFORMANCE_H
+
+/*
+Performance.h -- collect timing of bulk operations
+Copyright (C) 2022 Dieter Baron and Thomas Klausner
+
+This file is part of ckmame, a program to check rom sets for MAME.
+The authors can be contacted at <ckmame@nih.at>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in
+   the documentation and/or other materials provided with the
+   distribution.
+3. The name of the author may not be used to endorse or promote
+   products derived from this software without specific prior
+   written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+class Performance {
+public:
+    class Measurement {
+    public:
+        Measurement(Performance *performance_, std::string name_, uint64_t count_ = 0) : performance(performance_), name(std::move(name_)), count(count_), start(std::chrono::steady_clock::now()) { }
+        ~Measurement() { performance->add(name, count, std::chrono::steady_clock::now() - start); }
+
+        void add(uint64_t n) { count += n; }
+
+    private:
+        Performance *performance;
+        std::string name;
+        uint64_t count;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    void add(const std::string &name, uint64_t count, std::chrono::steady_clock::duration duration);
+    void clear();
+    void print();
+
+private:
+    class Counter {
+    public:
+        Counter() : count(0), duration(0) { }
+
+        uint64_t count;
+        std::chrono::steady_clock::duration duration;
+    };
+
+    std::mutex mutex;
+    std::map<std::string, Counter> counters;
+};
+
+extern Performance performance;
+
+#endif // HAD_PERFORMANCE_H
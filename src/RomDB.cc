@@ -36,12 +36,16 @@
 #include "Exception.h"
 #include "globals.h"
 
+#define DEFAULT_GAME_CACHE_SIZE 1024
+
 std::unique_ptr<RomDB> db;
 std::unique_ptr<RomDB> old_db;
 
+size_t RomDB::game_cache_size = DEFAULT_GAME_CACHE_SIZE;
+
 const DB::DBFormat RomDB::format = {
     0x0,
-    3,
+    4,
     "\
 create table dat (\n\
     dat_idx integer primary key,\n\
@@ -76,6 +80,11 @@ create table file (\n\
 );\n\
 create index file_game_type on file (game_id, file_type);\n\
 \n\
+create table missing_parent (\n\
+    name text primary key,\n\
+    parent text not null\n\
+);\n\
+\n\
 create table rule (\n\
     rule_idx integer primary key,\n\
     start_offset integer,\n\
@@ -94,7 +103,16 @@ create table test (\n\
     result integer not null,\n\
     primary key (rule_idx, test_idx)\n\
 );\n",
-    {}
+    {
+        /* games of the migrated database may have lost their parent, so the row with empty name marks missing parents as unknown */
+        { MigrationVersions(3, 4), "\
+create table missing_parent (\n\
+    name text primary key,\n\
+    parent text not null\n\
+);\n\
+insert into missing_parent (name, parent) values ('', '');\n" }
+    },
+    3 // version 4 only added missing_parent, which is only used when updating
 };
 
 const std::string RomDB::init2_sql = "\
@@ -106,12 +124,15 @@ create index file_sha1 on file (sha1);\n";
 
 
 std::unordered_map<int, std::string> RomDB::queries = {
+    {  DELETE_DAT, "delete from dat where dat_idx >= 0" },
     {  DELETE_FILE, "delete from file where game_id = :game_id" },
     {  DELETE_GAME, "delete from game where game_id = :game_id" },
+    {  DELETE_MISSING_PARENT, "delete from missing_parent where name = :name" },
     {  INSERT_DAT_DETECTOR, "insert into dat (dat_idx, name, author, version) values (-1, :name, :author, :version)" },
     {  INSERT_DAT, "insert into dat (dat_idx, name, description, version) values (:dat_idx, :name, :description, :version)" },
     {  INSERT_FILE, "insert into file (game_id, file_type, file_idx, name, merge, status, location, size, crc, md5, sha1) values (:game_id, :file_type, :file_idx, :name, :merge, :status, :location, :size, :crc, :md5, :sha1)" },
     {  INSERT_GAME, "insert into game (name, description, dat_idx, parent) values (:name, :description, :dat_idx, :parent)" },
+    {  INSERT_MISSING_PARENT, "insert into missing_parent (name, parent) values (:name, :parent)" },
     {  INSERT_RULE, "insert into rule (rule_idx, start_offset, end_offset, operation) values (:rule_idx, :start_offset, :end_offset, :operation)" },
     {  INSERT_TEST, "insert into test (rule_idx, test_idx, type, offset, size, mask, value, result) values (:rule_idx, :test_idx, :type, :offset, :size, :mask, :value, :result)" },
     {  QUERY_CLONES, "select name from game where parent = :parent" },
@@ -119,6 +140,7 @@ std::unordered_map<int, std::string> RomDB::queries = {
     {  QUERY_DAT, "select name, description, version from dat where dat_idx >= 0 order by dat_idx" },
     {  QUERY_FILE_FBN, "select g.name, f.file_idx from game g, file f where f.game_id = g.game_id and f.file_type = :file_type and f.name = :name" },
     {  QUERY_FILE, "select name, merge, status, location, size, crc, md5, sha1 from file where game_id = :game_id and file_type = :file_type order by file_idx" },
+    {  QUERY_GAME_DATS, "select name, dat_idx from game" },
     {  QUERY_GAME_ID, "select game_id from game where name = :name" },
     {  QUERY_GAME, "select game_id, description, dat_idx, parent from game where name = :name" },
     {  QUERY_HAS_DISKS, "select file_idx from file where file_type = 1 limit 1" },
@@ -127,8 +149,10 @@ std::unordered_map<int, std::string> RomDB::queries = {
     {  QUERY_HASH_TYPE_SHA1, "select name from file where file_type = :file_type and sha1 not null limit 1" },
     {  QUERY_LIST_DISK, "select distinct name from file where file_type = 1 order by name" },
     {  QUERY_LIST_GAME, "select name from game order by name" },
+    {  QUERY_MISSING_PARENTS, "select name, parent from missing_parent" },
     {  QUERY_PARENT_BY_NAME, "select parent from game where name = :name" },
     {  QUERY_PARENT, "select parent from game where game_id = :game_id" },
+    {  QUERY_PARENTS, "select name, parent from game" },
     {  QUERY_RULE, "select rule_idx, start_offset, end_offset, operation from rule order by rule_idx" },
     {  QUERY_STATS_FILES, "select file_type, count(name) amount, sum(size) total_size from file group by file_type order by file_type" },
     {  QUERY_STATS_GAMES, "select count(name) as amount from game" },
@@ -138,7 +162,7 @@ std::unordered_map<int, std::string> RomDB::queries = {
 };
 
 std::unordered_map<int, std::string> RomDB::parameterized_queries = {
-   {  QUERY_FILE_FBH, "select g.name as game_name, g.dat_idx, f.file_idx, f.name, f.size, f.crc, f.md5, f.sha1 from game g, file f where f.game_id = g.game_id and f.file_type = :file_type and f.status <> :status @HASH@" },
+   {  QUERY_FILE_FBH, "select g.name as game_name, g.dat_idx, f.file_idx, f.name, f.size, f.crc, f.md5, f.sha1 from game g, file f where f.game_id = g.game_id and f.file_type = :file_type and f.status <> :status @HASH@ order by f.game_id, f.file_idx" },
 
 };
 
@@ -369,6 +393,10 @@ bool RomDB::read_rules(Detector *detector) {
 
 
 std::vector<RomLocation> RomDB::read_file_by_hash(filetype_t ft, const Hashes &hashes) {
+    if (image) {
+        return image->read_file_by_hash(ft, hashes);
+    }
+
     auto stmt = get_statement(QUERY_FILE_FBH, hashes, false);
     
     stmt->set_int("file_type", ft);
@@ -393,6 +421,25 @@ std::vector<RomLocation> RomDB::read_file_by_hash(filetype_t ft, const Hashes &h
 static std::string chd_extension = ".chd";
 
 GamePtr RomDB::read_game(const std::string &name) {
+    auto it = game_cache.find(name);
+    if (it != game_cache.end()) {
+        game_cache_lru.splice(game_cache_lru.begin(), game_cache_lru, it->second);
+        return *it->second;
+    }
+
+    auto game = read_game_uncached(name);
+    if (game) {
+        cache_game(game);
+    }
+    return game;
+}
+
+
+GamePtr RomDB::read_game_uncached(const std::string &name) {
+    if (image) {
+        return image->read_game(name);
+    }
+
     auto stmt = get_statement(QUERY_GAME);
 
     stmt->set_string("name", name);
@@ -425,6 +472,74 @@ GamePtr RomDB::read_game(const std::string &name) {
 }
 
 
+std::unordered_map<std::string, size_t> RomDB::read_game_dats() {
+    auto stmt = get_statement(QUERY_GAME_DATS);
+
+    std::unordered_map<std::string, size_t> dats;
+
+    while (stmt->step()) {
+        dats[stmt->get_string("name")] = static_cast<size_t>(stmt->get_int("dat_idx"));
+    }
+
+    return dats;
+}
+
+
+/* Returns games whose parent didn't exist when they were written, with the name of the parent. */
+std::unordered_map<std::string, std::string> RomDB::read_missing_parents() {
+    auto stmt = get_statement(QUERY_MISSING_PARENTS);
+
+    std::unordered_map<std::string, std::string> parents;
+
+    while (stmt->step()) {
+        parents[stmt->get_string("name")] = stmt->get_string("parent");
+    }
+
+    return parents;
+}
+
+
+std::unordered_map<std::string, std::string> RomDB::read_parents() {
+    if (image) {
+        return image->read_parents();
+    }
+
+    auto stmt = get_statement(QUERY_PARENTS);
+
+    std::unordered_map<std::string, std::string> parents;
+
+    while (stmt->step()) {
+        parents[stmt->get_string("name")] = stmt->get_string("parent");
+    }
+
+    return parents;
+}
+
+
+void RomDB::cache_game(const GamePtr &game) {
+    if (game_cache_size == 0) {
+        return;
+    }
+
+    game_cache_lru.push_front(game);
+    game_cache[game->name] = game_cache_lru.begin();
+
+    if (game_cache_lru.size() > game_cache_size) {
+        game_cache.erase(game_cache_lru.back()->name);
+        game_cache_lru.pop_back();
+    }
+}
+
+
+void RomDB::uncache_game(const std::string &name) {
+    auto it = game_cache.find(name);
+    if (it != game_cache.end()) {
+        game_cache_lru.erase(it->second);
+        game_cache.erase(it);
+    }
+}
+
+
 void RomDB::read_files(Game *game, filetype_t ft) {
     auto stmt = get_statement(QUERY_FILE);
 
@@ -447,6 +562,10 @@ void RomDB::read_files(Game *game, filetype_t ft) {
 
 
 std::vector<std::string> RomDB::read_list(enum dbh_list type) {
+    if (image) {
+        return image->read_list(type);
+    }
+
     static const std::unordered_map<enum dbh_list, Statement> query_list = {
         { DBH_KEY_LIST_DISK, QUERY_LIST_DISK },
         { DBH_KEY_LIST_GAME, QUERY_LIST_GAME }
@@ -470,7 +589,10 @@ std::vector<std::string> RomDB::read_list(enum dbh_list type) {
 
 
 void RomDB::write_dat(const std::vector<DatEntry> &dats) {
-    auto stmt = get_statement(INSERT_DAT);
+    auto stmt = get_statement(DELETE_DAT);
+    stmt->execute();
+
+    stmt = get_statement(INSERT_DAT);
 
     for (size_t i = 0; i < dats.size(); i++) {
         auto &dat = dats[i];
@@ -551,6 +673,8 @@ void RomDB::write_rules(const Detector &detector) {
 
 
 void RomDB::delete_game(const std::string &name) {
+    uncache_game(name);
+
     auto stmt = get_statement(QUERY_GAME_ID);
 
     stmt->set_string("name", name);
@@ -576,6 +700,10 @@ void RomDB::delete_game(const std::string &name) {
     stmt->set_int("game_id", id);
     stmt->execute();
 
+    stmt = get_statement(DELETE_MISSING_PARENT);
+    stmt->set_string("name", name);
+    stmt->execute();
+
     if (!error.empty()) {
         throw Exception(error);
     }
@@ -583,6 +711,8 @@ void RomDB::delete_game(const std::string &name) {
 
 
 void RomDB::update_file_location(Game *game) {
+    uncache_game(game->name);
+
     auto stmt = get_statement(UPDATE_FILE);
 
     //     {  UPDATE_FILE, "update file set location = :location where game_id = :game_id and file_type = :file_type and file_idx = :file_idx" },
@@ -607,6 +737,10 @@ void RomDB::update_file_location(Game *game) {
 
 
 void RomDB::update_game_parent(const Game *game) {
+    /* clones of this game cache their grandparent, so drop everything */
+    game_cache.clear();
+    game_cache_lru.clear();
+
     auto stmt = get_statement(UPDATE_PARENT);
 
     stmt->set_string("parent", game->cloneof[0]);
@@ -641,6 +775,15 @@ void RomDB::write_game(Game *game) {
 }
 
 
+void RomDB::write_missing_parent(const std::string &name, const std::string &parent) {
+    auto stmt = get_statement(INSERT_MISSING_PARENT);
+
+    stmt->set_string("name", name);
+    stmt->set_string("parent", parent);
+    stmt->execute();
+}
+
+
 void RomDB::write_files(Game *game, filetype_t ft) {
     auto stmt = get_statement(INSERT_FILE);
 
@@ -34,9 +34,11 @@
   IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <list>
 #include <unordered_set>
 
 #include "DB.h"
+#include "RomDBImage.h"
 #include "RomLocation.h"
 #include "OutputContext.h"
 #include "Stats.h"
@@ -44,12 +46,15 @@
 class RomDB : public DB {
 public:
     enum Statement {
+        DELETE_DAT,
         DELETE_FILE,
         DELETE_GAME,
+        DELETE_MISSING_PARENT,
         INSERT_DAT_DETECTOR,
         INSERT_DAT,
         INSERT_FILE,
         INSERT_GAME,
+        INSERT_MISSING_PARENT,
         INSERT_RULE,
         INSERT_TEST,
         QUERY_CLONES,
@@ -57,6 +62,7 @@ public:
         QUERY_DAT,
         QUERY_FILE_FBN,
         QUERY_FILE,
+        QUERY_GAME_DATS,
         QUERY_GAME_ID,
         QUERY_GAME,
         QUERY_HAS_DISKS,
@@ -65,8 +71,10 @@ public:
         QUERY_HASH_TYPE_SHA1,
         QUERY_LIST_DISK,
         QUERY_LIST_GAME,
+        QUERY_MISSING_PARENTS,
         QUERY_PARENT_BY_NAME,
         QUERY_PARENT,
+        QUERY_PARENTS,
         QUERY_RULE,
         QUERY_STATS_FILES,
         QUERY_STATS_GAMES,
@@ -87,6 +95,7 @@ public:
     // These can't be static members, since they are initialized after the global Configuration. Thanks a lot, C++.
     static std::string default_name() { return "mame.db"; }
     static std::string default_old_name() { return "old.db"; }
+    static size_t game_cache_size;
     
     std::unordered_map<size_t, DetectorPtr> detectors;
 
@@ -95,6 +104,7 @@ public:
     void delete_game(const Game *game) { delete_game(game->name); }
     void delete_game(const std::string &name);
     bool has_disks();
+    void use_image(const std::string &name) { image = RomDBImage::open(name); }
 
     bool has_detector() const { return !detectors.empty(); }
     DetectorPtr get_detector(size_t id);
@@ -103,6 +113,9 @@ public:
     std::vector<DatEntry> read_dat();
     std::vector<RomLocation> read_file_by_hash(filetype_t ft, const Hashes &hashes);
     GamePtr read_game(const std::string &name);
+    std::unordered_map<std::string, size_t> read_game_dats();
+    std::unordered_map<std::string, std::string> read_missing_parents();
+    std::unordered_map<std::string, std::string> read_parents();
     int hashtypes(filetype_t);
     std::vector<std::string> read_list(enum dbh_list type);
     void update_file_location(Game *game);
@@ -111,6 +124,7 @@ public:
     void write_detector(const Detector &detector);
     void write_game(Game *game);
     void write_hashtypes(int, int);
+    void write_missing_parent(const std::string &name, const std::string &parent);
     int export_db(const std::unordered_set<std::string> &exclude, const DatEntry *dat, OutputContext *out);
     
 protected:
@@ -118,6 +132,11 @@ protected:
     
 private:
     int hashtypes_[TYPE_MAX];
+    std::unique_ptr<RomDBImage> image;
+
+    /* games read recently, most recently used first; callers must not modify them without writing them back */
+    std::list<GamePtr> game_cache_lru;
+    std::unordered_map<std::string, std::list<GamePtr>::iterator> game_cache;
     
     static const std::string init2_sql;
     static const Statement query_hash_type[];
@@ -127,7 +146,10 @@ private:
     DBStatement *get_statement(Statement name) { return get_statement_internal(name); }
     DBStatement *get_statement(ParameterizedStatement name, const Hashes &hashes, bool have_size) { return get_statement_internal(name, hashes, have_size); }
 
+    void cache_game(const GamePtr &game);
+    void uncache_game(const std::string &name);
     DetectorPtr read_detector();
+    GamePtr read_game_uncached(const std::string &name);
     void read_files(Game *game, filetype_t ft);
     void read_hashtypes(filetype_t type);
     bool read_rules(Detector *detector);
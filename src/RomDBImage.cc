@@ -0,0 +1,656 @@
+/*
+RomDBImage.cc -- read-only, memory-mapped image of ROM database
+Copyright (C) 2022 Dieter Baron and Thomas Klausner
+
+This file is part of ckmame, a program to check rom sets for MAME.
+The authors can be contacted at <ckmame@nih.at>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in
+   the documentation and/or other materials provided with the
+   distribution.
+3. The name of the author may not be used to endorse or promote
+   products derived from this software without specific prior
+   written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "RomDBImage.h"
+
+#include "config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <unordered_map>
+
+#include <sys/stat.h>
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "Exception.h"
+#include "file_util.h"
+#include "globals.h"
+#include "RomDB.h"
+#include "SharedFile.h"
+#include "util.h"
+
+#define IMAGE_MAGIC "CKMIMG\0"
+#define IMAGE_BYTE_ORDER 0x01020304
+#define IMAGE_VERSION 2
+
+/* offset of the file change counter in the SQLite database header */
+#define SQLITE_CHANGE_COUNTER_OFFSET 24
+
+struct RomDBImage::Header {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    uint64_t db_size;
+    int64_t db_mtime; // in nanoseconds
+    uint64_t db_inode;
+    uint32_t db_change_counter;
+    uint32_t padding;
+    uint64_t games_offset;
+    uint64_t games_count;
+    uint64_t files_offset;
+    uint64_t files_count;
+    uint64_t disks_offset;
+    uint64_t disks_count;
+    uint64_t index_offset[INDEX_MAX];
+    uint64_t index_count[INDEX_MAX];
+    uint64_t missing_offset[INDEX_MAX];
+    uint64_t missing_count[INDEX_MAX];
+    uint64_t strings_offset;
+    uint64_t strings_size;
+};
+
+struct RomDBImage::GameRecord {
+    uint64_t id;
+    uint32_t name;
+    uint32_t description;
+    uint32_t parent;
+    uint32_t grandparent;
+    uint32_t dat_no;
+    uint32_t detector_id;
+    uint32_t first_file;
+    uint32_t num_files[TYPE_MAX];
+    uint32_t padding;
+};
+
+struct RomDBImage::FileRecord {
+    uint64_t size;
+    uint32_t game;
+    uint32_t name;
+    uint32_t merge;
+    uint32_t crc;
+    uint32_t index;
+    uint8_t file_type;
+    uint8_t status;
+    uint8_t where;
+    uint8_t hash_types;
+    uint8_t md5[Hashes::SIZE_MD5];
+    uint8_t sha1[Hashes::SIZE_SHA1];
+    uint32_t padding;
+};
+
+static const int index_hash_type[] = { Hashes::TYPE_CRC, Hashes::TYPE_MD5, Hashes::TYPE_SHA1 };
+
+/* What identifies the version of the database an image was compiled from. */
+struct DBState {
+    uint64_t size;
+    int64_t mtime; // in nanoseconds
+    uint64_t inode;
+    uint32_t change_counter;
+};
+
+static bool get_db_state(const std::string &db_name, DBState *state);
+
+
+RomDBImage::RomDBImage(const std::string &file_name, const std::string &db_name) : data(nullptr), length(0), mapping(nullptr), header(nullptr) {
+#ifdef HAVE_MMAP
+    auto fd = ::open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw Exception("can't open '%s'", file_name.c_str()).append_system_error();
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        ::close(fd);
+        throw Exception("can't stat '%s'", file_name.c_str()).append_system_error();
+    }
+    length = static_cast<size_t>(st.st_size);
+    if (length > 0) {
+        mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        throw Exception("can't map '%s'", file_name.c_str()).append_system_error();
+    }
+    data = static_cast<const uint8_t *>(mapping);
+#else
+    contents = slurp(file_name);
+    data = reinterpret_cast<const uint8_t *>(contents.data());
+    length = contents.size();
+#endif
+
+    try {
+        if (length < sizeof(Header)) {
+            throw Exception("'%s' is not a ROM database image", file_name.c_str());
+        }
+        header = reinterpret_cast<const Header *>(data);
+        if (memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0 || header->byte_order != IMAGE_BYTE_ORDER) {
+            throw Exception("'%s' is not a ROM database image", file_name.c_str());
+        }
+        if (header->version != IMAGE_VERSION) {
+            throw Exception("'%s' has unsupported image version %u", file_name.c_str(), header->version);
+        }
+
+        DBState db_state{};
+        if (!get_db_state(db_name, &db_state) || db_state.size != header->db_size || db_state.mtime != header->db_mtime || db_state.inode != header->db_inode || db_state.change_counter != header->db_change_counter) {
+            throw Exception("'%s' is out of date", file_name.c_str());
+        }
+
+        games = section<GameRecord>(header->games_offset, header->games_count);
+        files = section<FileRecord>(header->files_offset, header->files_count);
+        disks = section<uint32_t>(header->disks_offset, header->disks_count);
+        for (size_t i = 0; i < INDEX_MAX; i++) {
+            indices[i] = section<uint32_t>(header->index_offset[i], header->index_count[i]);
+            missing[i] = section<uint32_t>(header->missing_offset[i], header->missing_count[i]);
+        }
+        strings = section<char>(header->strings_offset, header->strings_size);
+        if (header->strings_size == 0 || strings[header->strings_size - 1] != '\0' || !valid()) {
+            throw Exception("'%s' is corrupt", file_name.c_str());
+        }
+    }
+    catch (...) {
+#ifdef HAVE_MMAP
+        if (mapping != nullptr) {
+            munmap(mapping, length);
+        }
+#endif
+        throw;
+    }
+}
+
+
+RomDBImage::~RomDBImage() {
+#ifdef HAVE_MMAP
+    if (mapping != nullptr) {
+        munmap(mapping, length);
+    }
+#endif
+}
+
+
+std::unique_ptr<RomDBImage> RomDBImage::open(const std::string &db_name) {
+    auto file_name = file_name_for(db_name);
+
+    std::error_code ec;
+    if (!std::filesystem::exists(file_name, ec)) {
+        return nullptr;
+    }
+
+    try {
+        return std::make_unique<RomDBImage>(file_name, db_name);
+    }
+    catch (Exception &e) {
+        output.error("warning: not using image: %s", e.what());
+        return nullptr;
+    }
+}
+
+
+template<typename T> const T *RomDBImage::section(uint64_t offset, uint64_t count) const {
+    if (offset % alignof(T) != 0 || offset > length || count > (length - offset) / sizeof(T)) {
+        throw Exception("ROM database image is corrupt");
+    }
+    return reinterpret_cast<const T *>(data + offset);
+}
+
+
+/* Check that all references between records stay within their sections, so they can be followed unchecked later. */
+bool RomDBImage::valid() const {
+    for (size_t i = 0; i < header->games_count; i++) {
+        auto game = games + i;
+        if (!valid_string(game->name) || !valid_string(game->description) || !valid_string(game->parent) || !valid_string(game->grandparent)) {
+            return false;
+        }
+        uint64_t end = game->first_file;
+        for (size_t ft = 0; ft < TYPE_MAX; ft++) {
+            end += game->num_files[ft];
+        }
+        if (end > header->files_count) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < header->files_count; i++) {
+        auto file = files + i;
+        if (file->game >= header->games_count || file->file_type >= TYPE_MAX || !valid_string(file->name) || !valid_string(file->merge)) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < header->disks_count; i++) {
+        if (!valid_string(disks[i])) {
+            return false;
+        }
+    }
+
+    for (size_t type = 0; type < INDEX_MAX; type++) {
+        if (!std::all_of(indices[type], indices[type] + header->index_count[type], [this](uint32_t index) { return index < header->files_count; })) {
+            return false;
+        }
+        if (!std::all_of(missing[type], missing[type] + header->missing_count[type], [this](uint32_t index) { return index < header->files_count; })) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/* Since the pool ends in NUL, every string starting inside it also ends inside it. */
+bool RomDBImage::valid_string(uint32_t offset) const {
+    return offset < header->strings_size;
+}
+
+
+const RomDBImage::GameRecord *RomDBImage::find_game(const std::string &name) const {
+    auto end = games + header->games_count;
+    auto it = std::lower_bound(games, end, name, [this](const GameRecord &game, const std::string &key) { return strcmp(string(game.name), key.c_str()) < 0; });
+
+    if (it == end || name != string(it->name)) {
+        return nullptr;
+    }
+    return it;
+}
+
+
+GamePtr RomDBImage::read_game(const std::string &name) const {
+    auto record = find_game(name);
+
+    if (record == nullptr) {
+        return nullptr;
+    }
+
+    auto game = std::make_shared<Game>();
+    game->id = record->id;
+    game->name = name;
+    game->description = string(record->description);
+    game->dat_no = record->dat_no;
+    game->cloneof[0] = string(record->parent);
+    game->cloneof[1] = string(record->grandparent);
+
+    auto file = files + record->first_file;
+    for (size_t ft = 0; ft < TYPE_MAX; ft++) {
+        for (size_t i = 0; i < record->num_files[ft]; i++) {
+            auto rom = make_rom(file);
+            rom.merge = string(file->merge);
+            rom.status = static_cast<Rom::Status>(file->status);
+            rom.where = static_cast<where_t>(file->where);
+            game->files[ft].push_back(rom);
+            file++;
+        }
+    }
+
+    return game;
+}
+
+
+std::vector<RomLocation> RomDBImage::read_file_by_hash(filetype_t ft, const Hashes &hashes) const {
+    std::vector<uint32_t> candidates;
+
+    size_t type = INDEX_MAX;
+    for (size_t i = INDEX_MAX; i > 0; i--) {
+        if (hashes.has_type(index_hash_type[i - 1])) {
+            type = i - 1;
+            break;
+        }
+    }
+
+    if (type == INDEX_MAX) {
+        for (uint32_t i = 0; i < header->files_count; i++) {
+            candidates.push_back(i);
+        }
+    }
+    else {
+        auto compare = [this, type, ft](uint32_t a, const Hashes &key) {
+            auto file = files + a;
+            if (file->file_type != ft) {
+                return file->file_type < ft ? -1 : 1;
+            }
+            switch (type) {
+                case INDEX_CRC:
+                    return file->crc < key.crc ? -1 : file->crc > key.crc ? 1 : 0;
+                case INDEX_MD5:
+                    return memcmp(file->md5, key.md5.data(), Hashes::SIZE_MD5);
+                default:
+                    return memcmp(file->sha1, key.sha1.data(), Hashes::SIZE_SHA1);
+            }
+        };
+        auto begin = indices[type];
+        auto end = begin + header->index_count[type];
+        auto it = std::lower_bound(begin, end, hashes, [&compare](uint32_t a, const Hashes &key) { return compare(a, key) < 0; });
+        while (it != end && compare(*it, hashes) == 0) {
+            candidates.push_back(*it);
+            it++;
+        }
+        /* files without this hash type match any value, as in the SQL query */
+        candidates.insert(candidates.end(), missing[type], missing[type] + header->missing_count[type]);
+    }
+
+    /* same order as the SQL query: by game id, then by position in game */
+    std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+        auto id_a = games[files[a].game].id;
+        auto id_b = games[files[b].game].id;
+        return id_a != id_b ? id_a < id_b : a < b;
+    });
+
+    std::vector<RomLocation> result;
+    for (auto i : candidates) {
+        auto file = files + i;
+        if (!matches(file, ft, hashes)) {
+            continue;
+        }
+        auto game = games + file->game;
+        result.emplace_back(string(game->name), game->detector_id, file->index, make_rom(file));
+    }
+
+    return result;
+}
+
+
+std::vector<std::string> RomDBImage::read_list(enum dbh_list type) const {
+    std::vector<std::string> result;
+
+    switch (type) {
+        case DBH_KEY_LIST_DISK:
+            for (size_t i = 0; i < header->disks_count; i++) {
+                result.emplace_back(string(disks[i]));
+            }
+            break;
+
+        case DBH_KEY_LIST_GAME:
+            for (size_t i = 0; i < header->games_count; i++) {
+                result.emplace_back(string(games[i].name));
+            }
+            break;
+
+        default:
+            throw Exception("unknown type %d", type);
+    }
+
+    return result;
+}
+
+
+std::unordered_map<std::string, std::string> RomDBImage::read_parents() const {
+    std::unordered_map<std::string, std::string> parents;
+
+    for (size_t i = 0; i < header->games_count; i++) {
+        parents[string(games[i].name)] = string(games[i].parent);
+    }
+
+    return parents;
+}
+
+
+bool RomDBImage::matches(const FileRecord *file, filetype_t ft, const Hashes &hashes) const {
+    if (file->file_type != ft || file->status == Rom::NO_DUMP) {
+        return false;
+    }
+    if (hashes.has_type(Hashes::TYPE_CRC) && (file->hash_types & Hashes::TYPE_CRC) && file->crc != hashes.crc) {
+        return false;
+    }
+    if (hashes.has_type(Hashes::TYPE_MD5) && (file->hash_types & Hashes::TYPE_MD5) && memcmp(file->md5, hashes.md5.data(), Hashes::SIZE_MD5) != 0) {
+        return false;
+    }
+    if (hashes.has_type(Hashes::TYPE_SHA1) && (file->hash_types & Hashes::TYPE_SHA1) && memcmp(file->sha1, hashes.sha1.data(), Hashes::SIZE_SHA1) != 0) {
+        return false;
+    }
+    return true;
+}
+
+
+Rom RomDBImage::make_rom(const FileRecord *file) const {
+    Rom rom;
+
+    rom.name = string(file->name);
+    if (file->hash_types & Hashes::TYPE_CRC) {
+        rom.hashes.set_crc(file->crc);
+    }
+    if (file->hash_types & Hashes::TYPE_MD5) {
+        rom.hashes.set_md5(file->md5);
+    }
+    if (file->hash_types & Hashes::TYPE_SHA1) {
+        rom.hashes.set_sha1(file->sha1);
+    }
+    rom.hashes.size = file->size;
+
+    return rom;
+}
+
+
+namespace {
+class StringPool {
+public:
+    StringPool() { add(""); }
+
+    uint32_t add(const std::string &s);
+    const std::string &data() const { return pool; }
+
+private:
+    std::string pool;
+    std::unordered_map<std::string, uint32_t> offsets;
+};
+
+uint32_t StringPool::add(const std::string &s) {
+    auto it = offsets.find(s);
+    if (it != offsets.end()) {
+        return it->second;
+    }
+    auto offset = static_cast<uint32_t>(pool.size());
+    pool += s;
+    pool += '\0';
+    offsets[s] = offset;
+    return offset;
+}
+}
+
+
+template<typename T> static uint64_t append_section(std::string &image, const std::vector<T> &items) {
+    image.resize((image.size() + 7) & ~static_cast<size_t>(7), '\0');
+    auto offset = image.size();
+    image.append(reinterpret_cast<const char *>(items.data()), items.size() * sizeof(T));
+    return offset;
+}
+
+
+void RomDBImage::write(const std::string &db_name) {
+    Header header{};
+    std::vector<GameRecord> game_records;
+    std::vector<FileRecord> file_records;
+    std::vector<uint32_t> disk_names;
+    std::vector<uint32_t> index[INDEX_MAX];
+    std::vector<uint32_t> missing_hash[INDEX_MAX];
+    StringPool strings;
+
+    {
+        auto rdb = std::make_unique<RomDB>(db_name, DBH_READ);
+
+        for (const auto &name : rdb->read_list(DBH_KEY_LIST_GAME)) {
+            auto game = rdb->read_game(name);
+            if (!game) {
+                throw Exception("game '%s' vanished while writing image", name.c_str());
+            }
+
+            GameRecord record{};
+            record.id = game->id;
+            record.name = strings.add(game->name);
+            record.description = strings.add(game->description);
+            record.parent = strings.add(game->cloneof[0]);
+            record.grandparent = strings.add(game->cloneof[1]);
+            record.dat_no = static_cast<uint32_t>(game->dat_no);
+            record.detector_id = static_cast<uint32_t>(rdb->get_detector_id_for_dat(game->dat_no));
+            record.first_file = static_cast<uint32_t>(file_records.size());
+
+            for (size_t ft = 0; ft < TYPE_MAX; ft++) {
+                record.num_files[ft] = static_cast<uint32_t>(game->files[ft].size());
+                for (size_t i = 0; i < game->files[ft].size(); i++) {
+                    const auto &rom = game->files[ft][i];
+                    FileRecord file{};
+
+                    file.size = rom.hashes.size;
+                    file.game = static_cast<uint32_t>(game_records.size());
+                    file.name = strings.add(rom.name);
+                    file.merge = strings.add(rom.merge);
+                    file.index = static_cast<uint32_t>(i);
+                    file.file_type = static_cast<uint8_t>(ft);
+                    file.status = static_cast<uint8_t>(rom.status);
+                    file.where = static_cast<uint8_t>(rom.where);
+                    file.hash_types = static_cast<uint8_t>(rom.hashes.get_types());
+                    file.crc = rom.hashes.crc;
+                    if (rom.hashes.has_type(Hashes::TYPE_MD5)) {
+                        memcpy(file.md5, rom.hashes.md5.data(), Hashes::SIZE_MD5);
+                    }
+                    if (rom.hashes.has_type(Hashes::TYPE_SHA1)) {
+                        memcpy(file.sha1, rom.hashes.sha1.data(), Hashes::SIZE_SHA1);
+                    }
+                    file_records.push_back(file);
+                }
+            }
+            game_records.push_back(record);
+        }
+
+        for (const auto &name : rdb->read_list(DBH_KEY_LIST_DISK)) {
+            disk_names.push_back(strings.add(name));
+        }
+    }
+
+    for (uint32_t i = 0; i < file_records.size(); i++) {
+        const auto &file = file_records[i];
+        if (file.status == Rom::NO_DUMP) {
+            continue;
+        }
+        for (size_t type = 0; type < INDEX_MAX; type++) {
+            if (file.hash_types & index_hash_type[type]) {
+                index[type].push_back(i);
+            }
+            else {
+                missing_hash[type].push_back(i);
+            }
+        }
+    }
+
+    std::sort(index[INDEX_CRC].begin(), index[INDEX_CRC].end(), [&file_records](uint32_t a, uint32_t b) {
+        const auto &fa = file_records[a];
+        const auto &fb = file_records[b];
+        return fa.file_type != fb.file_type ? fa.file_type < fb.file_type : fa.crc < fb.crc;
+    });
+    std::sort(index[INDEX_MD5].begin(), index[INDEX_MD5].end(), [&file_records](uint32_t a, uint32_t b) {
+        const auto &fa = file_records[a];
+        const auto &fb = file_records[b];
+        return fa.file_type != fb.file_type ? fa.file_type < fb.file_type : memcmp(fa.md5, fb.md5, Hashes::SIZE_MD5) < 0;
+    });
+    std::sort(index[INDEX_SHA1].begin(), index[INDEX_SHA1].end(), [&file_records](uint32_t a, uint32_t b) {
+        const auto &fa = file_records[a];
+        const auto &fb = file_records[b];
+        return fa.file_type != fb.file_type ? fa.file_type < fb.file_type : memcmp(fa.sha1, fb.sha1, Hashes::SIZE_SHA1) < 0;
+    });
+
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.byte_order = IMAGE_BYTE_ORDER;
+    header.version = IMAGE_VERSION;
+    DBState db_state{};
+    if (!get_db_state(db_name, &db_state)) {
+        throw Exception("can't stat '%s'", db_name.c_str()).append_system_error();
+    }
+    header.db_size = db_state.size;
+    header.db_mtime = db_state.mtime;
+    header.db_inode = db_state.inode;
+    header.db_change_counter = db_state.change_counter;
+
+    std::string image(sizeof(header), '\0');
+    header.games_offset = append_section(image, game_records);
+    header.games_count = game_records.size();
+    header.files_offset = append_section(image, file_records);
+    header.files_count = file_records.size();
+    header.disks_offset = append_section(image, disk_names);
+    header.disks_count = disk_names.size();
+    for (size_t type = 0; type < INDEX_MAX; type++) {
+        header.index_offset[type] = append_section(image, index[type]);
+        header.index_count[type] = index[type].size();
+        header.missing_offset[type] = append_section(image, missing_hash[type]);
+        header.missing_count[type] = missing_hash[type].size();
+    }
+    header.strings_offset = image.size();
+    header.strings_size = strings.data().size();
+    image += strings.data();
+    memcpy(image.data(), &header, sizeof(header));
+
+    auto file_name = file_name_for(db_name);
+    auto temp_file_name = make_unique_name(file_name, "");
+    try {
+        auto f = make_shared_file(temp_file_name, "wb");
+        if (!f || fwrite(image.data(), 1, image.size(), f.get()) != image.size() || fflush(f.get()) != 0) {
+            throw Exception("can't write '%s'", temp_file_name.c_str()).append_system_error();
+        }
+        f = nullptr;
+        std::filesystem::rename(temp_file_name, file_name);
+    }
+    catch (...) {
+        std::error_code ec;
+        std::filesystem::remove(temp_file_name, ec);
+        throw;
+    }
+}
+
+
+/* Get what identifies the version of the database. Size and modification time can stay the same when it is rewritten quickly, but SQLite increments the file change counter on every write transaction. */
+static bool get_db_state(const std::string &db_name, DBState *state) {
+    struct stat st;
+
+    if (stat(db_name.c_str(), &st) < 0) {
+        return false;
+    }
+
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(db_name, ec);
+    if (ec) {
+        return false;
+    }
+
+    uint8_t counter[4];
+    auto f = make_shared_file(db_name, "rb");
+    if (!f || fseek(f.get(), SQLITE_CHANGE_COUNTER_OFFSET, SEEK_SET) != 0 || fread(counter, 1, sizeof(counter), f.get()) != sizeof(counter)) {
+        return false;
+    }
+
+    state->size = static_cast<uint64_t>(st.st_size);
+    state->mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch()).count();
+    state->inode = static_cast<uint64_t>(st.st_ino);
+    state->change_counter = static_cast<uint32_t>(counter[0]) << 24 | static_cast<uint32_t>(counter[1]) << 16 | static_cast<uint32_t>(counter[2]) << 8 | counter[3];
+    return true;
+}
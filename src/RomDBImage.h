@@ -0,0 +1,95 @@
+#ifndef HAD_ROMDB_IMAGE_H
+#define HAD_ROMDB_IMAGE_H
+
+/*
+RomDBImage.h -- read-only, memory-mapped image of ROM database
+Copyright (C) 2022 Dieter Baron and Thomas Klausner
+
+This file is part of ckmame, a program to check rom sets for MAME.
+The authors can be contacted at <ckmame@nih.at>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in
+   the documentation and/or other materials provided with the
+   distribution.
+3. The name of the author may not be used to endorse or promote
+   products derived from this software without specific prior
+   written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DB.h"
+#include "Game.h"
+#include "RomLocation.h"
+
+class RomDB;
+
+/* Compact, immutable image of a ROM database, written by mkmamedb and
+   mapped into memory by ckmame and dumpgame. It is only used while it
+   matches the SQLite database it was compiled from. */
+
+class RomDBImage {
+public:
+    RomDBImage(const std::string &file_name, const std::string &db_name);
+    ~RomDBImage();
+
+    static std::string file_name_for(const std::string &db_name) { return db_name + ".image"; }
+    static std::unique_ptr<RomDBImage> open(const std::string &db_name);
+    static void write(const std::string &db_name);
+
+    GamePtr read_game(const std::string &name) const;
+    std::vector<RomLocation> read_file_by_hash(filetype_t ft, const Hashes &hashes) const;
+    std::vector<std::string> read_list(enum dbh_list type) const;
+    std::unordered_map<std::string, std::string> read_parents() const;
+
+private:
+    struct Header;
+    struct GameRecord;
+    struct FileRecord;
+
+    enum { INDEX_CRC, INDEX_MD5, INDEX_SHA1, INDEX_MAX };
+
+    const uint8_t *data;
+    size_t length;
+    void *mapping;
+    std::string contents;
+
+    const Header *header;
+    const GameRecord *games;
+    const FileRecord *files;
+    const uint32_t *disks;
+    const uint32_t *indices[INDEX_MAX];
+    const uint32_t *missing[INDEX_MAX];
+    const char *strings;
+
+    const GameRecord *find_game(const std::string &name) const;
+    const char *string(uint32_t offset) const { return strings + offset; }
+    bool valid() const;
+    bool valid_string(uint32_t offset) const;
+    bool matches(const FileRecord *file, filetype_t ft, const Hashes &hashes) const;
+    Rom make_rom(const FileRecord *file) const;
+    template<typename T> const T *section(uint64_t offset, uint64_t count) const;
+};
+
+#endif // HAD_ROMDB_IMAGE_H
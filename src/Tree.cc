@@ -33,6 +33,8 @@
 
 #include "Tree.h"
 
+#include <unordered_set>
+
 #include "check.h"
 #include "check_util.h"
 #include "diagnostics.h"
@@ -43,24 +45,58 @@
 #include "sighandle.h"
 #include "warn.h"
 #include "CkmameCache.h"
+#include "WorkerPool.h"
+
+// number of families prepared per worker thread in one batch
+#define TRAVERSE_BATCH_SIZE_PER_JOB 4
+
+class HashJob {
+public:
+    explicit HashJob(ArchivePtr archive_) : archive(std::move(archive_)) { }
+
+    ArchivePtr archive;
+    std::vector<size_t> indices;
+    std::vector<std::optional<Hashes>> hashes;
+
+    void compute();
+    void release();
+};
+
+/* hashes computed for a file, applied only if the file wasn't changed in the meantime */
+class ComputedHashes {
+public:
+    ComputedHashes(const File &file, const Hashes &hashes_) : name(file.name), size(file.hashes.size), mtime(file.mtime), hashes(hashes_) { }
+
+    std::string name;
+    uint64_t size;
+    time_t mtime;
+    Hashes hashes;
+};
+
+/* computed hashes by archive name, applied when the archive is opened by traverse_internal() */
+static std::unordered_map<std::string, std::vector<ComputedHashes>> computed_hashes;
 
+static void apply_computed_hashes(Archive *archive);
+static void prepare_hash_jobs(const Tree *tree, std::vector<HashJob> *jobs);
 
 Tree check_tree;
 
-bool Tree::add(const std::string &game_name) {
-    GamePtr game = db->read_game(game_name);
-    
-    if (!game) {
+bool Tree::add(const std::string &game_name, const std::unordered_map<std::string, std::string> &parents) {
+    auto it = parents.find(game_name);
+
+    if (it == parents.end()) {
 	return false;
     }
     
     auto tree = this;
+    const auto &parent = it->second;
 
-    if (!game->cloneof[1].empty()) {
-	tree = tree->add_node(game->cloneof[1], false);
-    }
-    if (!game->cloneof[0].empty()) {
-        tree = tree->add_node(game->cloneof[0], false);
+    if (!parent.empty()) {
+        auto grand_parent = parents.find(parent);
+        if (grand_parent != parents.end() && !grand_parent->second.empty()) {
+            tree = tree->add_node(grand_parent->second, false);
+        }
+        tree = tree->add_node(parent, false);
     }
 
     tree->add_node(game_name, true);
@@ -109,14 +145,56 @@ bool Tree::recheck_games_needing(filetype_t filetype, uint64_t size, const Hashe
 void Tree::traverse() {
     GameArchives archives[] = { GameArchives(), GameArchives(), GameArchives() };
 
-    for (const auto &it : children) {
-        it.second->traverse_internal(archives);
+    if (configuration.jobs <= 1) {
+        for (const auto &it : children) {
+            it.second->traverse_internal(archives);
+        }
+        return;
+    }
+
+    /* Hashes of the games' files are computed in parallel, one batch of families at a time.
+       Checking, fixing, and output are done sequentially in the usual order. */
+    auto pool = WorkerPool(configuration.jobs);
+    auto batch_size = configuration.jobs * TRAVERSE_BATCH_SIZE_PER_JOB;
+    auto it = children.begin();
+
+    while (it != children.end()) {
+        std::vector<std::vector<HashJob>> batch;
+
+        for (auto batch_it = it; batch_it != children.end() && batch.size() < batch_size; ++batch_it) {
+            batch.emplace_back();
+            prepare_hash_jobs(batch_it->second.get(), &batch.back());
+        }
+
+        for (auto &family_jobs : batch) {
+            for (auto &job : family_jobs) {
+                pool.add([&job]() { job.compute(); });
+            }
+        }
+        pool.wait();
+        exit_if_interrupted();
+
+        /* Release all archives before fixing any family, so no archive of a later family is held open while an earlier family changes it. */
+        for (auto &family_jobs : batch) {
+            for (auto &job : family_jobs) {
+                job.release();
+            }
+        }
+        for (size_t i = 0; i < batch.size(); i++) {
+            it->second->traverse_internal(archives);
+            ++it;
+        }
+        computed_hashes.clear();
     }
 }
 
 void Tree::traverse_internal(GameArchives *ancestor_archives) {
     GameArchives archives[] = { GameArchives(), ancestor_archives[0], ancestor_archives[1] };
-    
+
+    exit_if_interrupted();
+    if (ckmame_cache) {
+        ckmame_cache->flush_databases(true);
+    }
     if (siginfo_caught) {
         print_info("currently checking " + name);
     }
@@ -133,6 +211,9 @@ void Tree::traverse_internal(GameArchives *ancestor_archives) {
         }
         if (!full_name.empty()) {
             archives[0].archive[ft] = Archive::open(full_name, filetype, FILE_ROMSET, flags);
+            if (filetype == TYPE_ROM && archives[0].archive[ft] && !computed_hashes.empty()) {
+                apply_computed_hashes(archives[0].archive[ft].get());
+            }
         }
     }
 
@@ -223,3 +304,85 @@ void Tree::process(GameArchives *archives) {
 void Tree::clear() {
     children.clear();
 }
+
+
+static void prepare_hash_jobs(const Tree *tree, std::vector<HashJob> *jobs) {
+    if (tree->check && !tree->checked) {
+        auto full_name = findfile(TYPE_ROM, tree->name);
+        auto archive = full_name.empty() ? nullptr : Archive::open(full_name, TYPE_ROM, FILE_ROMSET, ARCHIVE_FL_CREATE);
+        auto game = archive ? db->read_game(tree->name) : nullptr;
+
+        if (game) {
+            /* only files that can match one of the game's ROMs get their hashes computed during checking */
+            std::unordered_set<uint64_t> sizes;
+            for (const auto &rom : game->files[TYPE_ROM]) {
+                sizes.insert(rom.hashes.size);
+            }
+
+            auto hashtypes = db->hashtypes(TYPE_ROM);
+            auto job = HashJob(archive);
+
+            for (size_t index = 0; index < archive->files.size(); index++) {
+                const auto &file = archive->files[index];
+
+                if (!file.broken && !file.hashes.has_all_types(hashtypes) && sizes.find(file.hashes.size) != sizes.end()) {
+                    job.indices.push_back(index);
+                }
+            }
+
+            if (!job.indices.empty() && archive->check()) {
+                jobs->push_back(std::move(job));
+            }
+        }
+    }
+
+    for (const auto &it : tree->children) {
+        prepare_hash_jobs(it.second.get(), jobs);
+    }
+}
+
+
+static void apply_computed_hashes(Archive *archive) {
+    auto it = computed_hashes.find(archive->name);
+    if (it == computed_hashes.end()) {
+        return;
+    }
+
+    for (const auto &computed : it->second) {
+        auto index = archive->file_index_by_name(computed.name);
+        if (!index.has_value()) {
+            continue;
+        }
+        auto &file = archive->files[index.value()];
+        if (file.broken || file.hashes.size != computed.size || file.mtime != computed.mtime) {
+            continue;
+        }
+        file.hashes.set_hashes(computed.hashes);
+        /* hashes were computed reading the whole file, like in file_ensure_hashes() */
+        file.data_verified = true;
+        archive->cache_changed = true;
+    }
+
+    computed_hashes.erase(it);
+}
+
+
+void HashJob::compute() {
+    for (auto index : indices) {
+        hashes.push_back(archive->file_compute_hashes(index));
+    }
+}
+
+
+/* Keep computed hashes by archive name and drop reference to archive. */
+void HashJob::release() {
+    auto &entries = computed_hashes[archive->name];
+
+    for (size_t i = 0; i < hashes.size(); i++) {
+        if (hashes[i].has_value()) {
+            entries.emplace_back(archive->files[indices[i]], hashes[i].value());
+        }
+    }
+
+    archive = nullptr;
+}
@@ -38,6 +38,7 @@
 #include <memory>
 
 #include <string>
+#include <unordered_map>
 
 #include "GameArchives.h"
 #include "Hashes.h"
@@ -59,7 +60,7 @@ public:
     
     std::map<std::string, TreePtr> children;
     
-    bool add(const std::string &game_name);
+    bool add(const std::string &game_name, const std::unordered_map<std::string, std::string> &parents);
     bool recheck(const std::string &game_name);
     bool recheck_games_needing(filetype_t filetype, uint64_t size, const Hashes *hashes);
     void traverse();
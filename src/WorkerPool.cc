@@ -0,0 +1,137 @@
+/*
+WorkerPool.cc -- run jobs on a fixed number of threads
+Copyright (C) 2022 Dieter Baron and Thomas Klausner
+
+This file is part of ckmame, a program to check rom sets for MAME.
+The authors can be contacted at <ckmame@nih.at>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in
+   the documentation and/or other materials provided with the
+   distribution.
+3. The name of the author may not be used to endorse or promote
+   products derived from this software without specific prior
+   written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "WorkerPool.h"
+
+#include <chrono>
+
+#include "sighandle.h"
+
+#define INTERRUPT_CHECK_INTERVAL std::chrono::milliseconds(100)
+
+WorkerPool::WorkerPool(size_t size) : active(0), stopping(false) {
+    if (size == 0) {
+        size = 1;
+    }
+    try {
+        for (size_t i = 0; i < size; i++) {
+            threads.emplace_back(&WorkerPool::run, this);
+        }
+    }
+    catch (...) {
+        stop();
+        throw;
+    }
+}
+
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+
+/* Stop threads once all jobs are done and wait for them to exit. */
+void WorkerPool::stop() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobs_available.notify_all();
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+
+void WorkerPool::add(std::function<void()> job) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    jobs_available.notify_one();
+}
+
+
+// Wait until all jobs added so far are finished. Rethrows the first exception thrown by a job.
+// When interrupted, jobs that haven't started yet are dropped; callers must check for the interrupt before using results.
+void WorkerPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (!jobs_done.wait_for(lock, INTERRUPT_CHECK_INTERVAL, [this]() { return jobs.empty() && active == 0; })) {
+        if (interrupt_caught) {
+            jobs.clear();
+        }
+    }
+
+    if (exception) {
+        auto ex = exception;
+        exception = nullptr;
+        std::rethrow_exception(ex);
+    }
+}
+
+
+void WorkerPool::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        jobs_available.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+        if (jobs.empty()) {
+            return;
+        }
+
+        auto job = std::move(jobs.front());
+        jobs.pop_front();
+        active++;
+        lock.unlock();
+
+        try {
+            job();
+        }
+        catch (...) {
+            lock.lock();
+            if (!exception) {
+                exception = std::current_exception();
+            }
+            lock.unlock();
+        }
+
+        lock.lock();
+        active--;
+        if (jobs.empty() && active == 0) {
+            jobs_done.notify_all();
+        }
+    }
+}
@@ -32,168 +32,661 @@
 */
 
 
-#include "config.h"
-
 #include "XmlProcessor.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include <libxml/xmlreader.h>
+
 #include "globals.h"
 
+#define XML_BUFFER_SIZE (64 * 1024)
+
+static const char *whitespace = " \t\r\n";
+
+static void append_utf8(std::string &s, unsigned long c);
+static bool get_encoding(std::string_view declaration, std::string &encoding);
+static bool is_latin1_encoding(const std::string &encoding);
+static bool is_utf8_encoding(const std::string &encoding);
+
 XmlProcessor::XmlProcessor(LineNumberCallback line_number_callback_, const std::unordered_map<std::string, Entity> &entities_, void *context_) :
     line_number_callback(line_number_callback_),
     entities(entities_),
     context(context_),
     ok(true),
-    stop_parsing(false) { }
-
+    stop_parsing(false),
+    source(nullptr),
+    buffer_position(0),
+    buffer_end(0),
+    eof(false),
+    line_number(1),
+    reported_line_number(0),
+    latin1(false),
+    entity_text(nullptr) { }
 
-#ifndef HAVE_LIBXML2
 
-int XmlProcessor::parse(ParserSource *parser_source) {
-    output.file_error("support for XML parsing not compiled in.");
-    return -1;
-}
+XmlProcessor::Attribute::Attribute(XmlProcessor::AttributeCallback callback_, const void *arguments_):
+    cb_attr(callback_), arguments(arguments_) { }
 
-#else
 
-#include <libxml/xmlreader.h>
+XmlProcessor::State::State(std::string name_, std::string path_, const Entity *entity_) :
+    name(std::move(name_)),
+    path(std::move(path_)),
+    entity(entity_) {
+    if (entity != nullptr) {
+	for (const auto &it : entity->attr) {
+	    attributes.emplace_back(it.first, &it.second);
+	}
+    }
+}
 
-#include <utility>
 
-XmlProcessor::Attribute::Attribute(XmlProcessor::AttributeCallback callback_, const void *arguments_):
-    cb_attr(callback_), arguments(arguments_) { }
+/* Must be called before XML is parsed from several threads, in case the libxml2 reader is used. */
+void XmlProcessor::init() {
+    xmlInitParser();
+}
 
 
 bool XmlProcessor::parse(ParserSource *parser_source) {
-    auto reader_source = ReaderSource(parser_source);
-    auto reader = xmlReaderForIO(read, close, &reader_source, nullptr, nullptr, 0);
-    if (reader == nullptr) {
-	output.file_error("can't open\n");
-	return -1;
-    }
-
+    source = parser_source;
+    buffer.resize(XML_BUFFER_SIZE);
+    buffer_position = 0;
+    buffer_end = 0;
+    eof = false;
+    line_number = 1;
+    reported_line_number = 0;
+    latin1 = false;
+    states.clear();
+    states.emplace_back("", "", nullptr);
+    open_elements = {0};
+    entity_text = nullptr;
     ok = true;
     stop_parsing = false;
 
-    process_tree(reader);
+    if (!check_encoding()) {
+	return parse_libxml2();
+    }
 
-    xmlFreeTextReader(reader);
+    while (!stop_parsing) {
+	auto start = scan("<", 0);
+	if (start == std::string::npos) {
+	    if (!parse_text(view(0, buffer_end - buffer_position))) {
+		return false;
+	    }
+	    break;
+	}
+	if (start > 0) {
+	    if (!parse_text(view(0, start))) {
+		return false;
+	    }
+	    advance(start);
+	}
+
+	while (buffer_end - buffer_position < 9 && fill()) {
+	}
+	auto markup = view(0, buffer_end - buffer_position);
+	size_t end;
+	auto good = true;
+
+	if (markup.compare(0, 4, "<!--") == 0) {
+	    end = scan("-->", 4);
+	    if (end == std::string::npos) {
+		return syntax_error("unterminated comment");
+	    }
+	    end += 2;
+	}
+	else if (markup.compare(0, 9, "<![CDATA[") == 0) {
+	    /* CDATA sections are not used in dats, ignore them. */
+	    end = scan("]]>", 9);
+	    if (end == std::string::npos) {
+		return syntax_error("unterminated CDATA section");
+	    }
+	    end += 2;
+	}
+	else if (markup.compare(0, 2, "<!") == 0) {
+	    /* document type declaration, skipped including internal subset */
+	    end = scan_markup_end(true);
+	    if (end == std::string::npos) {
+		return syntax_error("unterminated declaration");
+	    }
+	}
+	else if (markup.compare(0, 2, "<?") == 0) {
+	    end = scan("?>", 2);
+	    if (end == std::string::npos) {
+		return syntax_error("unterminated processing instruction");
+	    }
+	    auto instruction = view(2, end);
+	    if (instruction.compare(0, 3, "xml") == 0 && instruction.length() > 3 && strchr(whitespace, instruction[3]) != nullptr) {
+		good = parse_xml_declaration(instruction.substr(4));
+	    }
+	    end += 1;
+	}
+	else if (markup.compare(0, 2, "</") == 0) {
+	    end = scan(">", 2);
+	    if (end == std::string::npos) {
+		return syntax_error("unterminated end tag");
+	    }
+	    good = parse_element_end(end);
+	}
+	else {
+	    end = scan_markup_end(false);
+	    if (end == std::string::npos) {
+		return syntax_error("unterminated start tag");
+	    }
+	    good = parse_element_start(end);
+	}
+
+	if (!good) {
+	    return false;
+	}
+	advance(end + 1);
+    }
+
+    if (!stop_parsing) {
+	if (states[0].children.empty()) {
+	    return syntax_error("no root element");
+	}
+	if (open_elements.size() > 1) {
+	    return syntax_error("premature end of file");
+	}
+    }
 
     return ok;
 }
 
-void XmlProcessor::process_tree(void *reader_) {
-    auto reader = reinterpret_cast<xmlTextReader *>(reader_);
 
-    const Entity *entity_text = nullptr;
-    std::string path;
+void XmlProcessor::advance(size_t length) {
+    auto data = buffer.data() + buffer_position;
+    line_number += static_cast<size_t>(std::count(data, data + length, '\n'));
+    buffer_position += length;
+}
+
 
-    int ret;
-    while ((ret = xmlTextReaderRead(reader)) == 1) {
-	if (line_number_callback) {
-	    line_number_callback(context, static_cast<size_t>(xmlTextReaderGetParserLineNumber(reader)));
+/* Skips UTF-8 byte order mark. Returns false if input is in an encoding the built-in parser doesn't support. */
+bool XmlProcessor::check_encoding() {
+    while (buffer_end - buffer_position < 6 && fill()) {
+    }
+    auto start = view(0, buffer_end - buffer_position);
+
+    if (start.compare(0, 3, "\xef\xbb\xbf") == 0) {
+	advance(3);
+	return true;
+    }
+    /* UTF-16 or UTF-32, with or without byte order mark */
+    if (start.compare(0, 2, "\xfe\xff") == 0 || start.compare(0, 2, "\xff\xfe") == 0 || start.substr(0, 4).find('\0') != std::string::npos) {
+	return false;
+    }
+
+    if (start.compare(0, 5, "<?xml") != 0 || start.length() < 6 || strchr(whitespace, start[5]) == nullptr) {
+	return true;
+    }
+    auto end = scan("?>", 5);
+    if (end == std::string::npos) {
+	/* reported by parse() */
+	return true;
+    }
+
+    std::string encoding;
+    if (!get_encoding(view(6, end), encoding)) {
+	return true;
+    }
+    return is_utf8_encoding(encoding) || is_latin1_encoding(encoding);
+}
+
+
+/* Append more data from source to buffer, keeping unconsumed data. Returns false at end of file. */
+bool XmlProcessor::fill() {
+    if (eof) {
+	return false;
+    }
+
+    if (buffer_position > 0) {
+	memmove(buffer.data(), buffer.data() + buffer_position, buffer_end - buffer_position);
+	buffer_end -= buffer_position;
+	buffer_position = 0;
+    }
+    if (buffer_end == buffer.size()) {
+	buffer.resize(buffer.size() * 2);
+    }
+
+    auto length = source->read(buffer.data() + buffer_end, buffer.size() - buffer_end);
+    if (length == 0) {
+	eof = true;
+	return false;
+    }
+    buffer_end += length;
+    return true;
+}
+
+
+/* Returns offset of pattern from current position, reading more data as needed. */
+size_t XmlProcessor::scan(std::string_view pattern, size_t offset) {
+    while (true) {
+	auto data = view(0, buffer_end - buffer_position);
+	auto index = data.find(pattern, offset);
+	if (index != std::string::npos) {
+	    return index;
+	}
+	if (data.length() >= pattern.length()) {
+	    offset = std::max(offset, data.length() - pattern.length() + 1);
+	}
+	if (!fill()) {
+	    return std::string::npos;
 	}
+    }
+}
 
-	switch (xmlTextReaderNodeType(reader)) {
-            case XML_READER_TYPE_ELEMENT: {
-                auto name = std::string(reinterpret_cast<const char *>(xmlTextReaderConstName(reader)));
-                path += '/' + name;
-                
-                auto entity = find(path);
-                if (entity != nullptr) {
-                    if (entity->cb_open) {
-			try {
-			    handle_callback_status(entity->cb_open(context, entity->arguments));
-			}
-			catch (std::exception &e) {
-                            output.file_error("parse error: %s", e.what());
-			    ok = false;
-			}
-
-			if (stop_parsing) {
-			    return;
-			}
-                    }
-                    
-                    for (const auto &it : entity->attr) {
-                        auto &attribute = it.second;
-                        auto value = reinterpret_cast<char *>(xmlTextReaderGetAttribute(reader, reinterpret_cast<const xmlChar *>(it.first.c_str())));
-
-                        if (value != nullptr) {
-			    try {
-				handle_callback_status(attribute.cb_attr(context, attribute.arguments, value));
-			    }
-			    catch (std::exception &e) {
-                                output.file_error("parse error: %s", e.what());
-				ok = false;
-			    }
-                            free(value);
-
-			    if (stop_parsing) {
-				return;
-			    }
-                        }
-                    }
-
-		    if (entity->cb_text) {
-			entity_text = entity;
-		    }
-                }
-                
-                if (!xmlTextReaderIsEmptyElement(reader)) {
-                    break;
-                }
-            }
-                /*
-                 Fallthrough for empty elements, as we won't get an
-                 extra close.
-                 */
-
-            case XML_READER_TYPE_END_ELEMENT: {
-                auto entity = find(path);
-                if (entity != nullptr) {
-		    if (entity->cb_close) {
-			try {
-			    handle_callback_status(entity->cb_close(context, entity->arguments));
-			}
-                        catch (std::exception &e) {
-                            output.file_error("parse error: %s", e.what());
-			    ok = false;
-			}
-
-			if (stop_parsing) {
-			    return;
-			}
+
+/* Returns offset of '>' closing the markup at current position, skipping quoted strings (and internal subset of declarations). */
+size_t XmlProcessor::scan_markup_end(bool declaration) {
+    size_t offset = 1;
+    size_t depth = 0;
+    char quote = 0;
+
+    while (true) {
+	auto data = view(0, buffer_end - buffer_position);
+
+	while (offset < data.length()) {
+	    auto c = data[offset];
+
+	    if (quote != 0) {
+		if (c == quote) {
+		    quote = 0;
+		}
+	    }
+	    else if (c == '"' || c == '\'') {
+		quote = c;
+	    }
+	    else if (declaration && c == '[') {
+		depth += 1;
+	    }
+	    else if (declaration && c == ']' && depth > 0) {
+		depth -= 1;
+	    }
+	    else if (declaration && c == '<' && depth > 0) {
+		if (offset + 4 > data.length()) {
+		    break;
+		}
+		if (data.compare(offset, 4, "<!--") == 0) {
+		    offset = scan("-->", offset + 4);
+		    if (offset == std::string::npos) {
+			return std::string::npos;
 		    }
-                }
+		    offset += 2;
+		    data = view(0, buffer_end - buffer_position);
+		}
+	    }
+	    else if (c == '>' && depth == 0) {
+		return offset;
+	    }
+	    offset += 1;
+	}
 
-                path.resize(path.find_last_of('/'));
-                entity_text = nullptr;
+	if (!fill()) {
+	    return std::string::npos;
+	}
+    }
+}
 
-                break;
-            }
-                
-	case XML_READER_TYPE_TEXT:
-                if (entity_text) {
-		    try {
-			handle_callback_status(entity_text->cb_text(context, entity_text->arguments, (const char *)xmlTextReaderConstValue(reader)));
+
+size_t XmlProcessor::child_state(size_t parent, std::string_view name) {
+    auto it = states[parent].children.find(name);
+    if (it != states[parent].children.end()) {
+	return it->second;
+    }
+
+    auto path = states[parent].path + '/' + std::string(name);
+    auto entity = find(path);
+    auto index = states.size();
+    states[parent].children[std::string(name)] = index;
+    states.emplace_back(std::string(name), path, entity);
+    return index;
+}
+
+
+void XmlProcessor::close_element(size_t state) {
+    auto entity = states[state].entity;
+    entity_text = nullptr;
+
+    if (entity != nullptr && entity->cb_close) {
+	report_line_number();
+	call(entity->cb_close, entity->arguments);
+    }
+}
+
+
+bool XmlProcessor::parse_element_end(size_t end) {
+    auto name = view(2, end);
+    auto name_end = name.find_last_not_of(whitespace);
+    name = name.substr(0, name_end == std::string::npos ? 0 : name_end + 1);
+
+    if (open_elements.size() == 1 || states[open_elements.back()].name != name) {
+	return syntax_error("unexpected end tag '" + std::string(name) + "'");
+    }
+
+    auto state = open_elements.back();
+    open_elements.pop_back();
+    close_element(state);
+
+    return true;
+}
+
+
+bool XmlProcessor::parse_element_start(size_t end) {
+    auto tag = view(1, end);
+    auto empty = !tag.empty() && tag.back() == '/';
+    if (empty) {
+	tag.remove_suffix(1);
+    }
+
+    auto name = tag.substr(0, tag.find_first_of(whitespace));
+    if (name.empty()) {
+	return syntax_error("missing element name");
+    }
+    if (open_elements.size() == 1 && !states[0].children.empty()) {
+	return syntax_error("extra content after root element");
+    }
+
+    element_attributes.clear();
+    auto position = name.length();
+    while ((position = tag.find_first_not_of(whitespace, position)) != std::string::npos) {
+	auto equals = tag.find('=', position);
+	if (equals == std::string::npos) {
+	    return syntax_error("attribute without value");
+	}
+	auto attribute_name = tag.substr(position, equals - position);
+	attribute_name = attribute_name.substr(0, attribute_name.find_first_of(whitespace));
+	auto start = tag.find_first_not_of(whitespace, equals + 1);
+	if (start == std::string::npos || (tag[start] != '"' && tag[start] != '\'')) {
+	    return syntax_error("attribute value not quoted");
+	}
+	auto value_end = tag.find(tag[start], start + 1);
+	if (value_end == std::string::npos) {
+	    return syntax_error("unterminated attribute value");
+	}
+	element_attributes.emplace_back(attribute_name, tag.substr(start + 1, value_end - start - 1));
+	position = value_end + 1;
+    }
+
+    auto state = child_state(open_elements.back(), name);
+    auto entity = states[state].entity;
+
+    if (entity != nullptr) {
+	report_line_number();
+
+	if (entity->cb_open) {
+	    call(entity->cb_open, entity->arguments);
+	    if (stop_parsing) {
+		return true;
+	    }
+	}
+
+	for (const auto &attribute : states[state].attributes) {
+	    for (const auto &element_attribute : element_attributes) {
+		if (element_attribute.first == attribute.first) {
+		    if (!unescape(element_attribute.second, true)) {
+			return false;
 		    }
-                    catch (std::exception &e) {
-                        output.file_error("parse error: %s", e.what());
-			ok = false;
+		    call(attribute.second->cb_attr, attribute.second->arguments, value);
+		    if (stop_parsing) {
+			return true;
 		    }
+		    break;
+		}
+	    }
+	}
+
+	if (entity->cb_text) {
+	    entity_text = entity;
+	}
+    }
+
+    if (empty) {
+	close_element(state);
+    }
+    else {
+	open_elements.push_back(state);
+    }
+
+    return true;
+}
 
+
+/* Parse input in encodings the built-in parser doesn't support, like windows-1252 or UTF-16, using libxml2's reader. */
+bool XmlProcessor::parse_libxml2() {
+    auto reader = xmlReaderForIO(read_libxml2, close_libxml2, this, nullptr, nullptr, 0);
+    if (reader == nullptr) {
+	output.file_error("can't open");
+	return false;
+    }
+
+    auto ret = 0;
+    while (!stop_parsing && (ret = xmlTextReaderRead(reader)) == 1) {
+	line_number = static_cast<size_t>(xmlTextReaderGetParserLineNumber(reader));
+
+	switch (xmlTextReaderNodeType(reader)) {
+	case XML_READER_TYPE_ELEMENT: {
+	    auto state = child_state(open_elements.back(), reinterpret_cast<const char *>(xmlTextReaderConstName(reader)));
+	    auto entity = states[state].entity;
+
+	    if (entity != nullptr) {
+		report_line_number();
+
+		if (entity->cb_open) {
+		    call(entity->cb_open, entity->arguments);
+		}
+
+		for (const auto &attribute : states[state].attributes) {
 		    if (stop_parsing) {
-			return;
+			break;
+		    }
+		    auto attribute_value = xmlTextReaderGetAttribute(reader, reinterpret_cast<const xmlChar *>(attribute.first.c_str()));
+		    if (attribute_value != nullptr) {
+			value = reinterpret_cast<const char *>(attribute_value);
+			xmlFree(attribute_value);
+			call(attribute.second->cb_attr, attribute.second->arguments, value);
 		    }
-                }
-                break;
+		}
+
+		if (entity->cb_text) {
+		    entity_text = entity;
+		}
+	    }
+
+	    if (xmlTextReaderIsEmptyElement(reader)) {
+		close_element(state);
+	    }
+	    else {
+		open_elements.push_back(state);
+	    }
+	    break;
+	}
+
+	case XML_READER_TYPE_END_ELEMENT:
+	    close_element(open_elements.back());
+	    open_elements.pop_back();
+	    break;
 
-            default:
-                break;
-        }
+	case XML_READER_TYPE_TEXT:
+	    if (entity_text != nullptr) {
+		report_line_number();
+		value = reinterpret_cast<const char *>(xmlTextReaderConstValue(reader));
+		call(entity_text->cb_text, entity_text->arguments, value);
+	    }
+	    break;
+
+	default:
+	    break;
+	}
     }
 
-    if (ret != 0) {
-	output.file_error("XML parse error");
+    xmlFreeTextReader(reader);
+
+    if (ret < 0) {
+	output.line_error(line_number, "XML parse error");
+	ok = false;
+    }
+
+    return ok;
+}
+
+
+bool XmlProcessor::parse_text(std::string_view text) {
+    if (text.find_first_not_of(whitespace) == std::string::npos) {
+	return true;
+    }
+    if (open_elements.size() == 1) {
+	return syntax_error("text outside of root element");
+    }
+    if (entity_text == nullptr) {
+	return true;
+    }
+
+    report_line_number();
+    if (!unescape(text, false)) {
+	return false;
+    }
+    call(entity_text->cb_text, entity_text->arguments, value);
+
+    return true;
+}
+
+
+bool XmlProcessor::parse_xml_declaration(std::string_view declaration) {
+    std::string encoding;
+    if (!get_encoding(declaration, encoding)) {
+	return syntax_error("invalid XML declaration");
+    }
+
+    if (is_utf8_encoding(encoding)) {
+	latin1 = false;
+    }
+    else if (is_latin1_encoding(encoding)) {
+	latin1 = true;
+    }
+    else {
+	return syntax_error("unsupported encoding '" + encoding + "'");
+    }
+
+    return true;
+}
+
+
+void XmlProcessor::report_line_number() {
+    if (line_number_callback && line_number != reported_line_number) {
+	line_number_callback(context, line_number);
+	reported_line_number = line_number;
+    }
+}
+
+
+bool XmlProcessor::syntax_error(const std::string &message) {
+    output.line_error(line_number, "XML parse error: %s", message.c_str());
+    ok = false;
+    return false;
+}
+
+
+/* Replace references and normalize white space in text, result is stored in value. */
+bool XmlProcessor::unescape(std::string_view text, bool attribute) {
+    if (!latin1 && text.find_first_of(attribute ? "&\t\n\r" : "&\r") == std::string::npos) {
+	value.assign(text.data(), text.length());
+	return true;
+    }
+
+    value.clear();
+    for (size_t i = 0; i < text.length(); i++) {
+	auto c = text[i];
+
+	switch (c) {
+	case '&': {
+	    auto end = text.find(';', i + 1);
+	    if (end == std::string::npos) {
+		return syntax_error("unterminated reference");
+	    }
+	    if (!unescape_reference(text.substr(i + 1, end - i - 1))) {
+		return false;
+	    }
+	    i = end;
+	    break;
+	}
+
+	case '\r':
+	    if (i + 1 < text.length() && text[i + 1] == '\n') {
+		i += 1;
+	    }
+	    value += attribute ? ' ' : '\n';
+	    break;
+
+	case '\t':
+	case '\n':
+	    value += attribute ? ' ' : c;
+	    break;
+
+	default:
+	    if (latin1 && (c & 0x80) != 0) {
+		append_utf8(value, static_cast<unsigned char>(c));
+	    }
+	    else {
+		value += c;
+	    }
+	    break;
+	}
+    }
+
+    return true;
+}
+
+
+bool XmlProcessor::unescape_reference(std::string_view reference) {
+    static const std::unordered_map<std::string_view, char> predefined = {
+	{"amp", '&'},
+	{"apos", '\''},
+	{"gt", '>'},
+	{"lt", '<'},
+	{"quot", '"'}
+    };
+
+    if (reference.length() > 1 && reference[0] == '#') {
+	auto hex = reference[1] == 'x';
+	auto digits = std::string(reference.substr(hex ? 2 : 1));
+	char *end;
+	auto c = strtoul(digits.c_str(), &end, hex ? 16 : 10);
+	if (digits.empty() || *end != '\0' || c == 0 || c > 0x10ffff) {
+	    return syntax_error("invalid character reference '&" + std::string(reference) + ";'");
+	}
+	append_utf8(value, c);
+	return true;
+    }
+
+    auto it = predefined.find(reference);
+    if (it == predefined.end()) {
+	return syntax_error("undefined entity '&" + std::string(reference) + ";'");
+    }
+    value += it->second;
+    return true;
+}
+
+
+void XmlProcessor::call(TagCallback callback, const void *arguments) {
+    try {
+	handle_callback_status(callback(context, arguments));
+    }
+    catch (std::exception &e) {
+	output.file_error("parse error: %s", e.what());
+	ok = false;
+    }
+}
+
+
+void XmlProcessor::call(AttributeCallback callback, const void *arguments, const std::string &argument) {
+    try {
+	handle_callback_status(callback(context, arguments, argument));
+    }
+    catch (std::exception &e) {
+	output.file_error("parse error: %s", e.what());
 	ok = false;
     }
 }
@@ -231,42 +724,79 @@ void XmlProcessor::handle_callback_status(CallbackStatus status) {
 }
 
 
-int XmlProcessor::close([[maybe_unused]] void *source) {
+int XmlProcessor::close_libxml2([[maybe_unused]] void *context) {
     return 0;
 }
 
 
-int XmlProcessor::read(void *source, char *b, int len) {
-    return static_cast<XmlProcessor::ReaderSource*>(source)->read(b, len);
+/* Passes on buffered data first, at most one line per call so libxml2 reports accurate line numbers. */
+int XmlProcessor::read_libxml2(void *context, char *data, int length) {
+    auto processor = static_cast<XmlProcessor *>(context);
+
+    if (processor->buffer_position == processor->buffer_end && !processor->fill()) {
+	return 0;
+    }
+
+    auto available = processor->view(0, processor->buffer_end - processor->buffer_position);
+    auto newline = available.find('\n');
+    auto n = std::min(newline == std::string::npos ? available.length() : newline + 1, static_cast<size_t>(length));
+    memcpy(data, available.data(), n);
+    processor->buffer_position += n;
+    return static_cast<int>(n);
 }
 
-int XmlProcessor::ReaderSource::read(char* b, int len) {
-    if (position >= buffer_length) {
-        if (eof) {
-            return 0;
-        }
 
-        buffer_length = static_cast<int>(source->read(buffer, sizeof(buffer)));
-        position = 0;
-        if (buffer_length == 0) {
-            eof = true;
-            return 0;
-        }
+/* Sets encoding to the one named in the XML declaration, in lower case, or empty if none is named. Returns false if declaration is invalid. */
+static bool get_encoding(std::string_view declaration, std::string &encoding) {
+    encoding.clear();
+
+    auto position = declaration.find("encoding");
+    if (position == std::string::npos) {
+	return true;
     }
 
-    int new_position;
-    auto newline = static_cast<char*>(memchr(buffer + position, '\n', buffer_length - position));
-    if (newline != nullptr) {
-        new_position = static_cast<int>(newline - buffer + 1);
+    auto start = declaration.find_first_of("\"'", position);
+    if (start == std::string::npos) {
+	return false;
     }
-    else {
-        new_position = buffer_length;
+    auto end = declaration.find(declaration[start], start + 1);
+    if (end == std::string::npos) {
+	return false;
     }
 
-    auto read_length = std::min(new_position - position, len);
-    memcpy(b, buffer + position, read_length);
-    position += read_length;
-    return read_length;
+    encoding = std::string(declaration.substr(start + 1, end - start - 1));
+    std::transform(encoding.begin(), encoding.end(), encoding.begin(), [](unsigned char c) { return std::tolower(c); });
+    return true;
 }
 
-#endif /* HAVE_LIBXML2 */
+
+static bool is_latin1_encoding(const std::string &encoding) {
+    return encoding == "iso-8859-1" || encoding == "latin1";
+}
+
+
+static bool is_utf8_encoding(const std::string &encoding) {
+    return encoding.empty() || encoding == "utf-8" || encoding == "us-ascii" || encoding == "ascii";
+}
+
+
+static void append_utf8(std::string &s, unsigned long c) {
+    if (c < 0x80) {
+	s += static_cast<char>(c);
+    }
+    else if (c < 0x800) {
+	s += static_cast<char>(0xc0 | (c >> 6));
+	s += static_cast<char>(0x80 | (c & 0x3f));
+    }
+    else if (c < 0x10000) {
+	s += static_cast<char>(0xe0 | (c >> 12));
+	s += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+	s += static_cast<char>(0x80 | (c & 0x3f));
+    }
+    else {
+	s += static_cast<char>(0xf0 | (c >> 18));
+	s += static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+	s += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+	s += static_cast<char>(0x80 | (c & 0x3f));
+    }
+}
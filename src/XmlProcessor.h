@@ -34,9 +34,12 @@
   IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <map>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "ParserSource.h"
 
@@ -74,21 +77,20 @@ class XmlProcessor {
 
     XmlProcessor(LineNumberCallback line_number_callback, const std::unordered_map<std::string, Entity> &entities, void *context);
 
+    static void init();
     bool parse(ParserSource *parser_source);
 
   private:
-    class ReaderSource {
+    /* Element at a specific path in the document, with the entity and attributes that apply to it. */
+    class State {
       public:
-        explicit ReaderSource(ParserSource *source) : source(source), buffer_length(0), position(0), eof(false) { }
+        State(std::string name_, std::string path_, const Entity *entity_);
 
-        int read(char *b, int len);
-
-      private:
-        ParserSource *source;
-        char buffer[8192];
-        int buffer_length;
-        int position;
-        bool eof;
+        std::string name;
+        std::string path;
+        const Entity *entity;
+        std::vector<std::pair<std::string, const Attribute *>> attributes;
+        std::map<std::string, size_t, std::less<>> children;
     };
 
     LineNumberCallback line_number_callback;
@@ -98,12 +100,48 @@ class XmlProcessor {
     bool ok;
     bool stop_parsing;
 
-    static int read(void *source, char *b, int len);
-    static int close([[maybe_unused]] void *source);
+    ParserSource *source;
+    std::vector<char> buffer;
+    size_t buffer_position;
+    size_t buffer_end;
+    bool eof;
+    size_t line_number;
+    size_t reported_line_number;
+    bool latin1;
+
+    std::vector<State> states;
+    std::vector<size_t> open_elements;
+    const Entity *entity_text;
+    std::vector<std::pair<std::string_view, std::string_view>> element_attributes;
+    std::string value;
 
     [[nodiscard]] const Entity *find(const std::string &path) const;
     void handle_callback_status(CallbackStatus status);
-    void process_tree(void *reader); // to avoid leaking libxml header
+    void call(TagCallback callback, const void *arguments);
+    void call(AttributeCallback callback, const void *arguments, const std::string &argument);
+
+    size_t child_state(size_t parent, std::string_view name);
+
+    void advance(size_t length);
+    bool check_encoding();
+    bool fill();
+    size_t scan(std::string_view pattern, size_t offset);
+    size_t scan_markup_end(bool declaration);
+    [[nodiscard]] std::string_view view(size_t start, size_t end) const { return {buffer.data() + buffer_position + start, end - start}; }
+
+    void close_element(size_t state);
+    bool parse_element_end(size_t end);
+    bool parse_element_start(size_t end);
+    bool parse_libxml2();
+    bool parse_text(std::string_view text);
+    bool parse_xml_declaration(std::string_view declaration);
+    void report_line_number();
+    bool syntax_error(const std::string &message);
+    bool unescape(std::string_view text, bool attribute);
+    bool unescape_reference(std::string_view reference);
+
+    static int close_libxml2(void *context);
+    static int read_libxml2(void *context, char *data, int length);
 };
 
 
@@ -48,6 +48,7 @@ bool Archive::commit() {
         output.set_error_archive(name);
 
         cache_changed = true;
+        CkmameCache::archive_changed(name);
 
         if (!commit_xxx()) {
             return false;
@@ -74,6 +75,7 @@ bool Archive::commit() {
                     if (is_indexed()) {
                         /* TODO: handle error (how?) */
                         memdb->insert_file(contents.get(), index);
+                        ArchiveContents::add_to_detector_worklist(contents->id);
                     }
                     change.status = Change::EXISTS;
                     break;
@@ -87,6 +89,7 @@ bool Archive::commit() {
         changes.resize(files.size());
 
         commit_cleanup();
+        contents->files_changed();
 
         modified = false;
     }
@@ -221,11 +224,18 @@ bool Archive::file_copy_part(Archive *source_archive, uint64_t source_index, con
     }
     else {
         try {
-            changes[files.size() - 1].source = source_archive->get_source(source_index, start, length);
+            /* raw data isn't checked against its CRC, so only copy it if it was verified */
+            if (full_file && accepts_compressed_sources() && source_archive->files[source_index].data_verified) {
+                changes[files.size() - 1].source = source_archive->get_compressed_source(source_index);
+            }
+            else {
+                changes[files.size() - 1].source = source_archive->get_source(source_index, start, length);
+            }
         }
         catch (Exception &ex) {
             files.pop_back();
             changes.pop_back();
+            contents->files_changed();
             return false;
         }
     }
@@ -284,6 +294,7 @@ bool Archive::file_rename(uint64_t index, const std::string &filename) {
         changes[index].original_name = files[index].name;
     }
     files[index].name = filename;
+    contents->files_changed();
     modified = true;
 
     return true;
@@ -338,6 +349,7 @@ bool Archive::rollback() {
                 break;
         }
     }
+    contents->files_changed();
 
     return true;
 }
@@ -357,6 +369,7 @@ void Archive::add_file(const std::string &filename, const Hashes *hashes, const
 
     files.push_back(file);
     changes.push_back(change);
+    contents->files_changed();
     
     modified = true;
 }
@@ -62,6 +62,11 @@ void check_archive_files(filetype_t filetype, const GameArchives &archives, cons
             continue;
         }
 
+        if (!archive->file_ensure_crc(i)) {
+            result->archive_files[filetype][i] = FS_BROKEN;
+            continue;
+        }
+
         size_t detector_id = 0;
         found = find_in_old(filetype, &file, archive.get(), nullptr);
         if (found == FIND_EXISTS) {
@@ -151,6 +156,11 @@ void check_needed_files(filetype_t filetype, const ArchivePtr& archive, Result *
             continue;
         }
 
+        if (!archive->file_ensure_crc(i)) {
+            result->archive_files[filetype][i] = FS_BROKEN;
+            continue;
+        }
+
         found = find_in_old(filetype, &file, archive.get(), nullptr);
         if (found == FIND_EXISTS) {
             // TODO: check that it also exists in ROM DB
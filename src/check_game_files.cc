@@ -161,7 +161,37 @@ static test_result_t match_files(const ArchivePtr& archive, test_t test, const G
 
     result = TEST_NOTFOUND;
 
-    for (size_t i = 0; result != TEST_USABLE && i < archive->files.size(); i++) {
+    // TODO: no detectors for disks
+    size_t detector_id = db->get_detector_id_for_dat(game->dat_no);
+
+    /* files that can pass test, in order */
+    std::vector<size_t> candidates;
+    switch (test) {
+        case TEST_NAME_SIZE_CHECKSUM:
+        case TEST_LONG:
+            candidates = archive->contents->file_indices_by_name(rom->name);
+            break;
+
+        case TEST_MERGENAME_SIZE_CHECKSUM:
+            candidates = archive->contents->file_indices_by_name(rom->merged_name());
+            break;
+
+        case TEST_SIZE_CHECKSUM:
+            if (detector_id == 0) {
+                candidates = archive->contents->file_indices_by_size_crc(*rom);
+            }
+            else {
+                /* detector hashes aren't indexed */
+                candidates.resize(archive->files.size());
+                for (size_t i = 0; i < candidates.size(); i++) {
+                    candidates[i] = i;
+                }
+            }
+            break;
+    }
+
+    for (size_t j = 0; result != TEST_USABLE && j < candidates.size(); j++) {
+        auto i = candidates[j];
         auto &file = archive->files[i];
 
 	if (file.broken) {
@@ -171,15 +201,11 @@ static test_result_t match_files(const ArchivePtr& archive, test_t test, const G
         switch (test) {
             case TEST_NAME_SIZE_CHECKSUM:
             case TEST_MERGENAME_SIZE_CHECKSUM: {
-                if ((test == TEST_NAME_SIZE_CHECKSUM ? rom->compare_name(file) : rom->compare_merged(file))) {
-                    // TODO: no detectors for disks
-                    size_t detector_id = db->get_detector_id_for_dat(game->dat_no);
-                    if (archive->compare_size_hashes(i, detector_id, rom)) {
-                        match->quality = Match::OK;
-                        result = TEST_USABLE;
-                        match->archive = archive;
-                        match->index = i;
-                    }
+                if (archive->compare_size_hashes(i, detector_id, rom)) {
+                    match->quality = Match::OK;
+                    result = TEST_USABLE;
+                    match->archive = archive;
+                    match->index = i;
                 }
                 break;
             }
@@ -190,8 +216,6 @@ static test_result_t match_files(const ArchivePtr& archive, test_t test, const G
                     break;
                 }
                 
-                // TODO: no detectors for disks
-                size_t detector_id = db->get_detector_id_for_dat(game->dat_no);
                 if (archive->compare_size_hashes(i, detector_id, rom)) {
                     match->quality = Match::NAME_ERROR;
                     result = TEST_USABLE;
@@ -207,7 +231,7 @@ static test_result_t match_files(const ArchivePtr& archive, test_t test, const G
                     break;
                 }
                 
-                if (rom->compare_name(file) && file.hashes.size > rom->hashes.size) {
+                if (file.hashes.size > rom->hashes.size) {
                     auto offset = archive->file_find_offset(i, rom->hashes.size, &rom->hashes);
                     if (offset.has_value()) {
                         match->offset = offset.value();
@@ -38,6 +38,7 @@
 #include <cstring>
 #include <filesystem>
 #include <string>
+#include <unordered_map>
 
 #include "compat.h"
 #include "config.h"
@@ -52,6 +53,7 @@
 #include "Fixdat.h"
 #include "globals.h"
 #include "MemDB.h"
+#include "Performance.h"
 #include "RomDB.h"
 #include "sighandle.h"
 #include "Stats.h"
@@ -66,9 +68,14 @@ std::filesystem::path rom_dir_normalized;
 
 
 std::vector<Commandline::Option> ckmame_options = {
+    Commandline::Option("cache-wal", "use write-ahead log for cache databases"),
     Commandline::Option("fix", 'F', "fix ROM set"),
     Commandline::Option("game-list", 'T', "file", "read games to check from file"),
-    Commandline::Option("only-if-database-updated", 'U', "if dats didn't change, exit; otherwise update database and run")
+    Commandline::Option("hash-thread-threshold", "size", "read files larger than size in a separate thread while hashing (0: never)"),
+    Commandline::Option("jobs", "n", "compute hashes using n threads (0: one per CPU)"),
+    Commandline::Option("max-open-archives", "n", "keep up to n unused archives open for reuse (0: close when unused)"),
+    Commandline::Option("only-if-database-updated", 'U', "if dats didn't change, exit; otherwise update database and run"),
+    Commandline::Option("report-performance", "print timing of bulk operations")
 };
 
 std::unordered_set<std::string> ckmame_used_variables = {
@@ -78,10 +85,12 @@ std::unordered_set<std::string> ckmame_used_variables = {
     "delete_unknown_pattern",
     "extra_directories",
     "fixdat_directory",
+    "hash_extra_on_demand",
     "keep_old_duplicate",
     "missing_list",
     "move_from_extra",
     "old_db",
+    "open_extra_on_demand",
     "report_changes",
     "report_correct",
     "report_detailed",
@@ -113,15 +122,30 @@ CkMame::CkMame() : Command("ckmame", "[game ...]", ckmame_options, ckmame_used_v
 
 void CkMame::global_setup(const ParsedCommandline &commandline) {
     for (const auto &option : commandline.options) {
-        if (option.name == "fix") {
+        if (option.name == "cache-wal") {
+            CkmameDB::write_ahead_log = true;
+        }
+        else if (option.name == "fix") {
             configuration.fix_romset = true;
         }
         else if (option.name == "game-list") {
             game_list = option.argument;
         }
+        else if (option.name == "hash-thread-threshold") {
+            Archive::hash_thread_threshold = size_from_string(option.argument);
+        }
+        else if (option.name == "jobs") {
+            configuration.jobs = jobs_from_string(option.argument);
+        }
+        else if (option.name == "max-open-archives") {
+            Archive::max_open_archives = count_from_string(option.argument);
+        }
         else if (option.name == "only-if-database-updated") {
             only_if_updated = true;
         }
+        else if (option.name == "report-performance") {
+            configuration.report_performance = true;
+        }
     }
 
     if (!configuration.fix_romset) {
@@ -129,6 +153,11 @@ void CkMame::global_setup(const ParsedCommandline &commandline) {
     }
 }
 
+bool CkMame::updates_dat_directories() const {
+    return only_if_updated || configuration.update_database;
+}
+
+
 bool CkMame::execute(const std::vector<std::string> &arguments) {
     int found;
     auto checking_all_games = false;
@@ -152,6 +181,7 @@ bool CkMame::execute(const std::vector<std::string> &arguments) {
 
     try {
         db = std::make_unique<RomDB>(configuration.rom_db, DBH_READ);
+        db->use_image(configuration.rom_db);
     } catch (std::exception &e) {
         output.error("can't open database '%s': %s", configuration.rom_db.c_str(), e.what());
         return false;
@@ -177,6 +207,8 @@ bool CkMame::execute(const std::vector<std::string> &arguments) {
     }
 
     ckmame_cache = std::make_shared<CkmameCache>();
+    signal(SIGINT, sighandle);
+    signal(SIGTERM, sighandle);
 
     try {
         ckmame_cache->register_directory(configuration.rom_directory);
@@ -201,14 +233,20 @@ bool CkMame::execute(const std::vector<std::string> &arguments) {
     }
 
     /* build tree of games to check */
+    auto tree_measurement = std::make_unique<Performance::Measurement>(&performance, "build check tree");
     std::vector<std::string> list;
+    std::unordered_map<std::string, std::string> parents;
 
     try {
-        list = db->read_list(DBH_KEY_LIST_GAME);
+        parents = db->read_parents();
     } catch (Exception &e) {
         output.error("list of games not found in database '%s': %s", configuration.rom_db.c_str(), e.what());
         return false;
     }
+    tree_measurement->add(parents.size());
+    for (const auto &it : parents) {
+        list.push_back(it.first);
+    }
     std::sort(list.begin(), list.end());
 
     if (!game_list.empty()) {
@@ -231,7 +269,7 @@ bool CkMame::execute(const std::vector<std::string> &arguments) {
             }
 
             if (std::binary_search(list.begin(), list.end(), b)) {
-                check_tree.add(b);
+                check_tree.add(b, parents);
             }
             else {
                 output.error("game '%s' unknown", b);
@@ -241,14 +279,14 @@ bool CkMame::execute(const std::vector<std::string> &arguments) {
     else if (arguments.empty()) {
         checking_all_games = true;
         for (const auto &name : list) {
-            check_tree.add(name);
+            check_tree.add(name, parents);
         }
     }
     else {
         for (const auto &argument : arguments) {
             if (strcspn(argument.c_str(), "*?[]{}") == argument.size()) {
                 if (std::binary_search(list.begin(), list.end(), argument)) {
-                    check_tree.add(argument);
+                    check_tree.add(argument, parents);
                 }
                 else {
                     output.error("game '%s' unknown", argument.c_str());
@@ -258,7 +296,7 @@ bool CkMame::execute(const std::vector<std::string> &arguments) {
                 found = 0;
                 for (const auto &j : list) {
                     if (fnmatch(argument.c_str(), j.c_str(), 0) == 0) {
-                        check_tree.add(j);
+                        check_tree.add(j, parents);
                         found = 1;
                     }
                 }
@@ -268,6 +306,8 @@ bool CkMame::execute(const std::vector<std::string> &arguments) {
         }
     }
 
+    tree_measurement = nullptr;
+
     MemDB::ensure();
 
     if (!ckmame_cache->superfluous_delete_list) {
@@ -286,6 +326,8 @@ bool CkMame::execute(const std::vector<std::string> &arguments) {
     check_tree.traverse();
     check_tree.traverse(); /* handle rechecks */
 
+    exit_if_interrupted();
+
     if (configuration.fix_romset) {
         if (!ckmame_cache->needed_delete_list) {
             ckmame_cache->needed_delete_list = std::make_shared<DeleteList>();
@@ -393,12 +435,20 @@ bool CkMame::execute(const std::vector<std::string> &arguments) {
 
 
 bool CkMame::cleanup() {
+    Archive::close_unused_archives();
+    restore_interrupt_handlers();
+    exit_if_interrupted();
     db = nullptr;
     old_db = nullptr;
     check_tree.clear();
     ckmame_cache = nullptr;
     ArchiveContents::clear_cache();
 
+    if (configuration.report_performance) {
+        performance.print();
+    }
+    performance.clear();
+
     return true;
 }
 
@@ -43,6 +43,7 @@
 #include "Garbage.h"
 #include "warn.h"
 #include "CkmameCache.h"
+#include "sighandle.h"
 
 
 static void cleanup_archive(filetype_t filetype, Archive *archive, Result *result, int flags);
@@ -59,6 +60,7 @@ void cleanup_list(const DeleteListPtr& list, int flags, where_t where) {
     auto n = list->archives.size();
     size_t i = 0;
     while (i < n) {
+        exit_if_interrupted();
         auto entry = list->archives[i];
         if (where == FILE_EXTRA && !configuration.extra_directory_move_from_extra(ckmame_cache->get_directory_name_for_archive(entry.name))) {
             i++;
@@ -33,6 +33,7 @@
 
 #include "Detector.h"
 
+#include <algorithm>
 #include <cstring>
 
 const uint64_t Detector::MAX_DETECTOR_FILE_SIZE = 128 * 1024 * 1024;
@@ -42,15 +43,156 @@ static const uint8_t bitswap[] = {
 };
 
 
-Hashes Detector::execute(const std::vector<uint8_t> &data) const {
-    for (auto &rule : rules) {
-        auto hashes = rule.execute(data);
-        if (hashes.has_size()) {
-            return hashes;
+Detector::Execution::Execution(const std::unordered_map<size_t, DetectorPtr> &detectors_, uint64_t size_) : size(size_), position(0) {
+    for (const auto &pair : detectors_) {
+        DetectorExecution detector;
+
+        detector.id = pair.first;
+        for (const auto &rule : pair.second->rules) {
+            detector.rules.emplace_back(&rule, size);
+        }
+        detectors.push_back(std::move(detector));
+    }
+}
+
+
+void Detector::Execution::update(const uint8_t *data, uint64_t length) {
+    for (auto &detector : detectors) {
+        auto decided = false;
+
+        for (auto &rule : detector.rules) {
+            if (decided) {
+                /* an earlier rule matches, so this one is not used */
+                rule.possible = false;
+                continue;
+            }
+            rule.update(data, length, position, &buffer);
+            if (rule.possible && rule.pending_tests.empty()) {
+                decided = true;
+            }
+        }
+    }
+
+    position += length;
+}
+
+
+void Detector::Execution::end(File *file) {
+    for (auto &detector : detectors) {
+        Hashes hashes;
+
+        for (auto &rule : detector.rules) {
+            if (rule.possible && rule.pending_tests.empty()) {
+                rule.hashes_update->end();
+                hashes = *rule.hashes;
+                hashes.size = rule.end - rule.start;
+                break;
+            }
         }
+
+        file->detector_hashes[detector.id] = hashes;
+    }
+}
+
+
+Detector::Execution::RuleExecution::RuleExecution(const Rule *rule, uint64_t size) : possible(false), operation(rule->operation), start(0), end(0), partial_unit_length(0) {
+    if (!rule->get_range(size, &start, &end)) {
+        return;
     }
 
-    return {};
+    for (const auto &test : rule->tests) {
+        if (test.is_data_test()) {
+            uint64_t offset;
+            if (!test.get_data_offset(size, &offset)) {
+                return;
+            }
+            pending_tests.emplace_back(&test, offset);
+        }
+        else if (!test.execute(size)) {
+            return;
+        }
+    }
+
+    possible = true;
+    hashes = std::make_unique<Hashes>();
+    hashes->add_types(Hashes::TYPE_ALL);
+    hashes_update = std::make_unique<Hashes::Update>(hashes.get());
+}
+
+
+/* Process data read from position: collect data for tests and hash the part in the rule's range. */
+void Detector::Execution::RuleExecution::update(const uint8_t *data, uint64_t length, uint64_t position, std::vector<uint8_t> *buffer) {
+    if (!possible) {
+        return;
+    }
+
+    auto block_end = position + length;
+
+    for (auto it = pending_tests.begin(); it != pending_tests.end();) {
+        auto test_end = it->offset + it->test->length;
+        auto copy_start = std::max(it->offset, position);
+        auto copy_end = std::min(test_end, block_end);
+
+        if (copy_start < copy_end) {
+            memcpy(it->data.data() + (copy_start - it->offset), data + (copy_start - position), copy_end - copy_start);
+        }
+        if (test_end <= block_end) {
+            if (!it->test->execute(it->data.data())) {
+                possible = false;
+                pending_tests.clear();
+                hashes_update = nullptr;
+                return;
+            }
+            it = pending_tests.erase(it);
+        }
+        else {
+            it++;
+        }
+    }
+
+    auto hash_start = std::max(start, position);
+    auto hash_end = std::min(end, block_end);
+    if (hash_start < hash_end) {
+        hash(data + (hash_start - position), hash_end - hash_start, buffer);
+    }
+}
+
+
+void Detector::Execution::RuleExecution::hash(const uint8_t *data, uint64_t length, std::vector<uint8_t> *buffer) {
+    if (operation == OP_NONE) {
+        hashes_update->update(data, length);
+        return;
+    }
+
+    auto unit_size = operation_unit_size(operation);
+
+    if (partial_unit_length > 0) {
+        auto n = std::min(unit_size - partial_unit_length, length);
+        memcpy(partial_unit + partial_unit_length, data, n);
+        partial_unit_length += n;
+        data += n;
+        length -= n;
+
+        if (partial_unit_length < unit_size) {
+            return;
+        }
+        uint8_t processed_unit[4];
+        process(operation, partial_unit, processed_unit, unit_size);
+        hashes_update->update(processed_unit, unit_size);
+        partial_unit_length = 0;
+    }
+
+    auto whole_units_length = length - length % unit_size;
+    if (whole_units_length > 0) {
+        if (buffer->size() < whole_units_length) {
+            buffer->resize(whole_units_length);
+        }
+        process(operation, data, buffer->data(), whole_units_length);
+        hashes_update->update(buffer->data(), whole_units_length);
+    }
+
+    partial_unit_length = length - whole_units_length;
+    memcpy(partial_unit, data + whole_units_length, partial_unit_length);
 }
 
 
@@ -86,159 +228,124 @@ bool Detector::Test::bit_cmp(const uint8_t *b) const {
 }
 
 
-Hashes Detector::Rule::compute_values(Operation operation, const std::vector<uint8_t> &data, uint64_t start, uint64_t length) const {
-    Hashes hashes;
-    
-    hashes.add_types(Hashes::TYPE_ALL);
-    Hashes::Update hu(&hashes);
-    
-    if (operation == OP_NONE) {
-        hu.update(data.data() + start, length);
-    }
-    else {
-        auto processed_data = std::vector<uint8_t>(length);
-
-        switch (operation) {
-        case OP_NONE:
-            // can't happen
-            break;
-        
-        case OP_BITSWAP:
-            for (size_t i = 0; i < length; i++) {
-                processed_data[i] = bitswap[data[start + i]];
-            }
-            break;
-                
-        case OP_BYTESWAP:
-            for (size_t i = 0; i < length; i += 2) {
-                processed_data[i] = data[start + i + 1];
-                processed_data[i + 1] = data[start + i];
-            }
-            break;
-
-        case OP_WORDSWAP:
-            for (size_t i = 0; i < length; i += 4) {
-                processed_data[i] = data[start + i + 3];
-                processed_data[i + 1] = data[start + i + 2];
-                processed_data[i + 2] = data[start + i + 1];
-                processed_data[i + 3] = data[start + i];
-            }
+void Detector::process(Operation operation, const uint8_t *data, uint8_t *processed_data, uint64_t length) {
+    switch (operation) {
+    case OP_NONE:
+        memcpy(processed_data, data, length);
+        break;
+
+    case OP_BITSWAP:
+        for (size_t i = 0; i < length; i++) {
+            processed_data[i] = bitswap[data[i]];
+        }
+        break;
+
+    case OP_BYTESWAP:
+        for (size_t i = 0; i < length; i += 2) {
+            processed_data[i] = data[i + 1];
+            processed_data[i + 1] = data[i];
         }
-        
-        hu.update(processed_data.data(), length);
+        break;
+
+    case OP_WORDSWAP:
+        for (size_t i = 0; i < length; i += 4) {
+            processed_data[i] = data[i + 3];
+            processed_data[i + 1] = data[i + 2];
+            processed_data[i + 2] = data[i + 1];
+            processed_data[i + 3] = data[i];
+        }
+        break;
     }
-    
-    hu.end();
-    
-    hashes.size = length;
-    return hashes;
 }
 
 
-
-Hashes Detector::Rule::execute(const std::vector<uint8_t> &data) const {
-    auto start = start_offset;
-    if (start < 0) {
-        start += static_cast<int64_t>(data.size());
+/* Compute range [start, end) of file of size the rule applies to, returns false if it is invalid. */
+bool Detector::Rule::get_range(uint64_t size, uint64_t *start, uint64_t *end) const {
+    auto file_size = static_cast<int64_t>(size);
+    auto range_start = start_offset;
+    if (range_start < 0) {
+        range_start += file_size;
     }
-    auto end = end_offset;
-    if (end == DETECTOR_OFFSET_EOF) {
-        end = static_cast<int64_t>(data.size());
+    auto range_end = end_offset;
+    if (range_end == DETECTOR_OFFSET_EOF) {
+        range_end = file_size;
     }
-    else if (end < 0) {
-        end += static_cast<int64_t>(data.size());
+    else if (range_end < 0) {
+        range_end += file_size;
     }
     
-    if (start < 0 || static_cast<uint64_t>(start) > data.size() || end < 0 || static_cast<uint64_t>(end) > data.size() || start > end || static_cast<uint64_t>(end - start) % operation_unit_size(operation) != 0) {
-        return {};
+    if (range_start < 0 || range_start > file_size || range_end < 0 || range_end > file_size || range_start > range_end || static_cast<uint64_t>(range_end - range_start) % operation_unit_size(operation) != 0) {
+        return false;
     }
 
-    for (auto &test : tests) {
-        if (!test.execute(data)) {
-            return {};
-        }
+    *start = static_cast<uint64_t>(range_start);
+    *end = static_cast<uint64_t>(range_end);
+    return true;
+}
+
+
+/* Compute offset of data tested in file of size, returns false if it isn't within the file, which fails the test. */
+bool Detector::Test::get_data_offset(uint64_t size, uint64_t *data_offset) const {
+    auto off = offset;
+
+    if (off < 0) {
+        off += size;
+    }
+
+    if (off < 0 || static_cast<uint64_t>(off) + length < static_cast<uint64_t>(off) || static_cast<uint64_t>(off) + length > size) {
+        return false;
     }
 
-    return compute_values(operation, data, static_cast<uint64_t>(start), static_cast<uint64_t>(end - start));
+    *data_offset = static_cast<uint64_t>(off);
+    return true;
 }
 
 
-bool Detector::Test::execute(const std::vector<uint8_t> &data) const {
-    auto match = false;
-    
-    switch (type) {
-        case TEST_DATA:
-        case TEST_OR:
-        case TEST_AND:
-        case TEST_XOR: {
-            auto off = offset;
-            
-            if (off < 0) {
-                off += data.size();
-            }
-            
-            if (off < 0 || static_cast<uint64_t>(off) + length < static_cast<uint64_t>(off) || static_cast<uint64_t>(off) + length > data.size()) {
-                return false;
-            }
-            
-            if (mask.empty()) {
-                match = (memcmp(data.data() + off, value.data(), length) == 0);
-            }
-            else {
-                match = bit_cmp(data.data() + off);
-            }
-            break;
-        }
+/* Execute data test on the length bytes of data at its offset. */
+bool Detector::Test::execute(const uint8_t *data) const {
+    bool match;
 
-        case TEST_FILE_EQ:
-        case TEST_FILE_LE:
-        case TEST_FILE_GR:
-            if (offset == DETECTOR_SIZE_POWER_OF_2) {
-                match = false;
-                for (auto i = 0; i < 64; i++) {
-                    if (data.size() == (static_cast<uint64_t>(1) << i)) {
-                        match = true;
-                        break;
-                    }
-                }
-            }
-            else {
-                int64_t cmp = offset - static_cast<int64_t>(data.size());
-                
-                switch (type) {
-                    case TEST_FILE_EQ:
-                        match = (cmp == 0);
-                        break;
-                    case TEST_FILE_LE:
-                        match = (cmp < 0);
-                        break;
-                    case TEST_FILE_GR:
-                        match = (cmp > 0);
-                        break;
-                        
-                    default:
-                        match = false;
-                }
-            }
-        }
-
-    if (match) {
-        return result;
+    if (mask.empty()) {
+        match = (memcmp(data, value.data(), length) == 0);
     }
     else {
-        return !result;
+        match = bit_cmp(data);
     }
+
+    return match ? result : !result;
 }
 
 
-bool Detector::compute_hashes(const std::vector<uint8_t> &data, File *file, const std::unordered_map<size_t, DetectorPtr> &detectors) {
-    if (file->get_size(0) > MAX_DETECTOR_FILE_SIZE) {
-        return false;
+/* Execute file size test on file of size. */
+bool Detector::Test::execute(uint64_t size) const {
+    auto match = false;
+
+    if (offset == DETECTOR_SIZE_POWER_OF_2) {
+        for (auto i = 0; i < 64; i++) {
+            if (size == (static_cast<uint64_t>(1) << i)) {
+                match = true;
+                break;
+            }
+        }
     }
-    
-    for (const auto &pair : detectors) {
-        file->detector_hashes[pair.first] = pair.second->execute(data);
+    else {
+        int64_t cmp = offset - static_cast<int64_t>(size);
+
+        switch (type) {
+            case TEST_FILE_EQ:
+                match = (cmp == 0);
+                break;
+            case TEST_FILE_LE:
+                match = (cmp < 0);
+                break;
+            case TEST_FILE_GR:
+                match = (cmp > 0);
+                break;
+
+            default:
+                match = false;
+        }
     }
-    
-    return true;
+
+    return match ? result : !result;
 }
@@ -155,10 +155,8 @@ DetectorPtr Detector::parse(ParserSource *parser_source) {
 	return nullptr;
     }
 
-    auto detector = parser_context.detector;
-    
-    detector->id = get_id(DetectorDescriptor(detector.get()));
-    return detector;
+    /* The id is assigned when the detector is written, since dats may be parsed in worker threads. */
+    return parser_context.detector;
 }
 
 
@@ -181,6 +181,7 @@ void Dumpgame::global_setup(const ParsedCommandline &commandline) {
 bool Dumpgame::execute(const std::vector<std::string> &arguments_) {
     try {
         db = std::make_unique<RomDB>(configuration.rom_db, DBH_READ);
+        db->use_image(configuration.rom_db);
     } catch (std::exception &e) {
         // TODO: catch exception for unsupported database version and report differently
         output.error("can't open database '%s': %s", configuration.rom_db.c_str(), strerror(errno));
@@ -34,7 +34,6 @@
 #include "find.h"
 
 #include "check_util.h"
-#include "DeleteList.h"
 #include "MemDB.h"
 #include "RomDB.h"
 #include "CkmameCache.h"
@@ -45,51 +44,14 @@ static find_result_t find_in_db(RomDB *rdb, filetype_t filetype, size_t detector
 
 static find_result_t find_in_archives_xxx(filetype_t filetype, size_t detector_id, const FileData *r, Match *m, bool needed_only);
 
-static bool compute_all_detector_hashes(DeleteListPtr list);
-
-bool compute_all_detector_hashes(bool needed_only) { // returns true if new hashes were computed
-    if (db->detectors.empty()) {
-        return false;
-    }
-    
-    auto got_new_hashes = false;
-    
-    if (compute_all_detector_hashes(ckmame_cache->needed_delete_list)) {
-        got_new_hashes = true;
-    }
-
+find_result_t find_in_archives(filetype_t filetype, size_t detector_id, const FileData *rom, Match *m, bool needed_only) {
     if (!needed_only) {
-        if (compute_all_detector_hashes(ckmame_cache->superfluous_delete_list)) {
-            got_new_hashes = true;
-        }
-        if (compute_all_detector_hashes(ckmame_cache->extra_delete_list)) {
-            got_new_hashes = true;
-        }
+        ckmame_cache->open_extra_candidates(filetype, rom);
     }
-    
-    return got_new_hashes;
-}
 
-static bool compute_all_detector_hashes(DeleteListPtr list) {
-    auto got_new_hashes = false;
-    for (const auto &entry : list->archives) {
-        auto contents = ArchiveContents::by_name(entry.filetype, entry.name);
-        if (contents == nullptr || contents->has_all_detector_hashes(db->detectors)) {
-            continue;
-        }
-        auto archive = Archive::open(contents);
-        if (archive->compute_detector_hashes(db->detectors)) {
-            got_new_hashes = true;
-        }
-    }
-    return got_new_hashes;
-}
-
-
-find_result_t find_in_archives(filetype_t filetype, size_t detector_id, const FileData *rom, Match *m, bool needed_only) {
     auto result = find_in_archives_xxx(filetype, detector_id, rom, m, needed_only);
     if (result == FIND_UNKNOWN) {
-        if (compute_all_detector_hashes(needed_only)) {
+        if (ArchiveContents::compute_pending_detector_hashes(needed_only)) {
             result = find_in_archives_xxx(filetype, detector_id, rom, m, needed_only);
         }
     }
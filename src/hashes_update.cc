@@ -48,13 +48,19 @@ extern "C" {
 #include "sha1_own.h"
 #endif
 
-#include <climits>
+#include <algorithm>
 #include <cstdlib>
 extern "C" {
 #include <zlib.h>
 }
 
 #include "Hashes.h"
+#include "hashes_x86.h"
+
+// Data is processed in blocks of this size, so each block is still in the CPU cache while it is run through all hash functions.
+#define HASHES_BLOCK_SIZE (16 * 1024)
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t length);
 
 class HashesContexts {
 public:
@@ -82,22 +88,26 @@ Hashes::Update::~Update() {
 }
 
 void Hashes::Update::update(const void *data, size_t length) {
-    size_t i = 0;
+    auto bytes = static_cast<const uint8_t *>(data);
+    auto want_crc = hashes->has_type(TYPE_CRC);
+    auto want_md5 = hashes->has_type(TYPE_MD5);
+    auto want_sha1 = hashes->has_type(TYPE_SHA1);
 
-    while (i < length) {
-	unsigned int n = length - i > UINT_MAX ? UINT_MAX : static_cast<unsigned int>(length - i);
+    while (length > 0) {
+        auto n = std::min(length, static_cast<size_t>(HASHES_BLOCK_SIZE));
 
-        if (hashes->has_type(TYPE_CRC)) {
-            contexts->crc = static_cast<uint32_t>(crc32(contexts->crc, static_cast<const Bytef *>(data), n));
+        if (want_crc) {
+            contexts->crc = crc32_update(contexts->crc, bytes, n);
         }
-        if (hashes->has_type(TYPE_MD5)) {
-            MD5Update(&contexts->md5, static_cast<const unsigned char *>(data), n);
+        if (want_md5) {
+            MD5Update(&contexts->md5, bytes, static_cast<unsigned int>(n));
         }
-        if (hashes->has_type(TYPE_SHA1)) {
-            SHA1Update(&contexts->sha1, static_cast<const uint8_t *>(data), n);
+        if (want_sha1) {
+            SHA1Update(&contexts->sha1, bytes, static_cast<unsigned int>(n));
         }
 
-        i += n;
+        bytes += n;
+        length -= n;
     }
 }
 
@@ -113,3 +123,21 @@ void Hashes::Update::end() {
         SHA1Final(hashes->sha1.data(), &contexts->sha1);
     }
 }
+
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t length) {
+#ifdef HAVE_X86_HASH_INTRINSICS
+    if (length >= HASHES_X86_CRC32_MINIMUM_LENGTH && hashes_x86_have_crc32()) {
+        auto n = length & ~static_cast<size_t>(15);
+        crc = hashes_x86_crc32(crc, data, n);
+        data += n;
+        length -= n;
+    }
+#endif
+
+    if (length > 0) {
+        crc = static_cast<uint32_t>(crc32(crc, data, static_cast<unsigned int>(length)));
+    }
+
+    return crc;
+}
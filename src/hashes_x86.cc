@@ -0,0 +1,338 @@
+/*
+hashes_x86.cc -- hash functions using x86 CPU extensions
+Copyright (C) 2022 Dieter Baron and Thomas Klausner
+
+This file is part of ckmame, a program to check rom sets for MAME.
+The authors can be contacted at <ckmame@nih.at>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in
+   the documentation and/or other materials provided with the
+   distribution.
+3. The name of the author may not be used to endorse or promote
+   products derived from this software without specific prior
+   written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "hashes_x86.h"
+
+#ifdef HAVE_X86_HASH_INTRINSICS
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+/* CPUID leaf 1, ecx */
+#define CPUID_SSSE3 (1u << 9)
+#define CPUID_SSE41 (1u << 19)
+#define CPUID_PCLMUL (1u << 1)
+/* CPUID leaf 7, ebx */
+#define CPUID_SHA (1u << 29)
+
+class CpuFeatures {
+public:
+    CpuFeatures();
+
+    bool crc32;
+    bool sha1;
+};
+
+CpuFeatures::CpuFeatures() : crc32(false), sha1(false) {
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return;
+    }
+    auto have_sse = (ecx & CPUID_SSSE3) && (ecx & CPUID_SSE41);
+    crc32 = have_sse && (ecx & CPUID_PCLMUL);
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return;
+    }
+    sha1 = have_sse && (ebx & CPUID_SHA);
+}
+
+static const CpuFeatures &cpu_features() {
+    static CpuFeatures features;
+
+    return features;
+}
+
+
+bool hashes_x86_have_crc32() {
+    return cpu_features().crc32;
+}
+
+
+bool hashes_x86_have_sha1() {
+    return cpu_features().sha1;
+}
+
+
+/* CRC-32 by folding with carry-less multiplication, as described in
+   "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction" (Intel, 2009).
+   Works on the bit-reflected, non-inverted CRC. */
+__attribute__((target("pclmul,sse4.1"))) static uint32_t crc32_fold(uint32_t crc, const uint8_t *data, size_t length) {
+    alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+    alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+    alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+    alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x00));
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x10));
+    x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x20));
+    x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x30));
+
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+
+    data += 64;
+    length -= 64;
+
+    /* fold 64 bytes at a time */
+    while (length >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x00));
+        y6 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x10));
+        y7 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x20));
+        y8 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        data += 64;
+        length -= 64;
+    }
+
+    /* fold into 128 bits */
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* fold remaining 16 byte blocks */
+    while (length >= 16) {
+        x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        data += 16;
+        length -= 16;
+    }
+
+    /* fold 128 bits to 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+
+uint32_t hashes_x86_crc32(uint32_t crc, const uint8_t *data, size_t length) {
+    return ~crc32_fold(~crc, data, length);
+}
+
+
+/* SHA-1 compression function using the SHA extensions, following Intel's reference implementation.
+   Each ROUNDS4 performs four rounds; MSG0-MSG3 hold the message schedule. */
+
+#define ROUNDS4(e_in, e_out, msg, function) \
+    e_in = _mm_sha1nexte_epu32(e_in, msg); \
+    e_out = abcd; \
+    abcd = _mm_sha1rnds4_epu32(abcd, e_in, function)
+
+__attribute__((target("sha,sse4.1"))) void hashes_x86_sha1_blocks(uint32_t state[5], const uint8_t *data, size_t blocks) {
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0x1b);
+    __m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+    __m128i e1, msg0, msg1, msg2, msg3;
+
+    while (blocks > 0) {
+        auto abcd_save = abcd;
+        auto e0_save = e0;
+
+        /* rounds 0-3 */
+        msg0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0)), mask);
+        e0 = _mm_add_epi32(e0, msg0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+        /* rounds 4-7 */
+        msg1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16)), mask);
+        ROUNDS4(e1, e0, msg1, 0);
+        msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+        /* rounds 8-11 */
+        msg2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 32)), mask);
+        ROUNDS4(e0, e1, msg2, 0);
+        msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+        msg0 = _mm_xor_si128(msg0, msg2);
+
+        /* rounds 12-15 */
+        msg3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 48)), mask);
+        msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+        ROUNDS4(e1, e0, msg3, 0);
+        msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+        msg1 = _mm_xor_si128(msg1, msg3);
+
+        /* rounds 16-19 */
+        msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+        ROUNDS4(e0, e1, msg0, 0);
+        msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+        msg2 = _mm_xor_si128(msg2, msg0);
+
+        /* rounds 20-23 */
+        msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+        ROUNDS4(e1, e0, msg1, 1);
+        msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+        msg3 = _mm_xor_si128(msg3, msg1);
+
+        /* rounds 24-27 */
+        msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+        ROUNDS4(e0, e1, msg2, 1);
+        msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+        msg0 = _mm_xor_si128(msg0, msg2);
+
+        /* rounds 28-31 */
+        msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+        ROUNDS4(e1, e0, msg3, 1);
+        msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+        msg1 = _mm_xor_si128(msg1, msg3);
+
+        /* rounds 32-35 */
+        msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+        ROUNDS4(e0, e1, msg0, 1);
+        msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+        msg2 = _mm_xor_si128(msg2, msg0);
+
+        /* rounds 36-39 */
+        msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+        ROUNDS4(e1, e0, msg1, 1);
+        msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+        msg3 = _mm_xor_si128(msg3, msg1);
+
+        /* rounds 40-43 */
+        msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+        ROUNDS4(e0, e1, msg2, 2);
+        msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+        msg0 = _mm_xor_si128(msg0, msg2);
+
+        /* rounds 44-47 */
+        msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+        ROUNDS4(e1, e0, msg3, 2);
+        msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+        msg1 = _mm_xor_si128(msg1, msg3);
+
+        /* rounds 48-51 */
+        msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+        ROUNDS4(e0, e1, msg0, 2);
+        msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+        msg2 = _mm_xor_si128(msg2, msg0);
+
+        /* rounds 52-55 */
+        msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+        ROUNDS4(e1, e0, msg1, 2);
+        msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+        msg3 = _mm_xor_si128(msg3, msg1);
+
+        /* rounds 56-59 */
+        msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+        ROUNDS4(e0, e1, msg2, 2);
+        msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+        msg0 = _mm_xor_si128(msg0, msg2);
+
+        /* rounds 60-63 */
+        msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+        ROUNDS4(e1, e0, msg3, 3);
+        msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+        msg1 = _mm_xor_si128(msg1, msg3);
+
+        /* rounds 64-67 */
+        msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+        ROUNDS4(e0, e1, msg0, 3);
+        msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+        msg2 = _mm_xor_si128(msg2, msg0);
+
+        /* rounds 68-71 */
+        msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+        ROUNDS4(e1, e0, msg1, 3);
+        msg3 = _mm_xor_si128(msg3, msg1);
+
+        /* rounds 72-75 */
+        msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+        ROUNDS4(e0, e1, msg2, 3);
+
+        /* rounds 76-79 */
+        ROUNDS4(e1, e0, msg3, 3);
+
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+
+        data += 64;
+        blocks -= 1;
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state), _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+}
+
+#endif /* HAVE_X86_HASH_INTRINSICS */
@@ -0,0 +1,55 @@
+#ifndef HAD_HASHES_X86_H
+#define HAD_HASHES_X86_H
+
+/*
+hashes_x86.h -- hash functions using x86 CPU extensions
+Copyright (C) 2022 Dieter Baron and Thomas Klausner
+
+This file is part of ckmame, a program to check rom sets for MAME.
+The authors can be contacted at <ckmame@nih.at>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in
+   the documentation and/or other materials provided with the
+   distribution.
+3. The name of the author may not be used to endorse or promote
+   products derived from this software without specific prior
+   written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cinttypes>
+#include <cstddef>
+
+#include "config.h"
+
+#ifdef HAVE_X86_HASH_INTRINSICS
+
+#define HASHES_X86_CRC32_MINIMUM_LENGTH 64
+
+bool hashes_x86_have_crc32();
+bool hashes_x86_have_sha1();
+
+// length must be a multiple of 16 and at least HASHES_X86_CRC32_MINIMUM_LENGTH
+uint32_t hashes_x86_crc32(uint32_t crc, const uint8_t *data, size_t length);
+void hashes_x86_sha1_blocks(uint32_t state[5], const uint8_t *data, size_t blocks);
+
+#endif
+
+#endif // HAD_HASHES_X86_H
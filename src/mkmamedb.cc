@@ -47,8 +47,11 @@
 #include "ParserDir.h"
 #include "ParserSourceFile.h"
 #include "ParserSourceZip.h"
+#include "Performance.h"
 #include "RomDB.h"
+#include "RomDBImage.h"
 #include "update_romdb.h"
+#include "util.h"
 #include "CkmameCache.h"
 
 std::vector<Commandline::Option> mkmamedb_options = {
@@ -58,6 +61,8 @@ std::vector<Commandline::Option> mkmamedb_options = {
     Commandline::Option("force", 'f', "recreate ROM database even if it is not out of date"),
     Commandline::Option("format", 'F', "format", "specify output format (default: db)"),
     Commandline::Option("hash-types", 'C', "types", "specify hash types to compute (default: all)"),
+    Commandline::Option("image", "also write memory-mapped image of ROM database"),
+    Commandline::Option("jobs", "n", "parse dats using n threads (0: one per CPU)"),
     Commandline::Option("list-available-dats", "list all dats found in dat-directories"),
     Commandline::Option("list-dats", "list dats used by current set"),
     Commandline::Option("no-directory-cache", "don't create cache of scanned input directory"),
@@ -66,6 +71,7 @@ std::vector<Commandline::Option> mkmamedb_options = {
     Commandline::Option("prog-description", "description", "set description of rominfo"),
     Commandline::Option("prog-name", "name", "set name of rominfo"),
     Commandline::Option("prog-version", "version", "set version of rominfo"),
+    Commandline::Option("report-performance", "print timing of bulk operations"),
     Commandline::Option("runtest", "output special format for use in ckmame test suite"),
     Commandline::Option("skip-files", "pattern", "don't use zip members matching shell glob pattern")
 };
@@ -137,6 +143,12 @@ void MkMameDB::global_setup(const ParsedCommandline &commandline) {
 		exit(1);
 	    }
 	}
+	else if (option.name == "image") {
+	    flags |= OUTPUT_FL_IMAGE;
+	}
+	else if (option.name == "jobs") {
+	    configuration.jobs = jobs_from_string(option.argument);
+	}
 	else if (option.name == "list-available-dats") {
 	    list_available_dats = true;
 	}
@@ -161,6 +173,9 @@ void MkMameDB::global_setup(const ParsedCommandline &commandline) {
 	else if (option.name == "prog-version") {
 	    dat.version = option.argument;
 	}
+	else if (option.name == "report-performance") {
+	    configuration.report_performance = true;
+	}
 	else if (option.name == "runtest") {
 	    runtest = true;
 	}
@@ -219,7 +234,9 @@ bool MkMameDB::execute(const std::vector<std::string> &arguments) {
 	}
 	else {
 	    try {
-		update_romdb(force);
+		if (!update_romdb(force, flags) && (flags & OUTPUT_FL_IMAGE)) {
+		    RomDBImage::write(configuration.rom_db);
+		}
 	    } catch (Exception &ex) {
 		output.error("can't update ROM database: %s", ex.what());
 		return false;
@@ -293,6 +310,11 @@ bool MkMameDB::execute(const std::vector<std::string> &arguments) {
 
 
 bool MkMameDB::global_cleanup() {
+    if (configuration.report_performance) {
+        performance.print();
+    }
+    performance.clear();
+
     return true;
 }
 
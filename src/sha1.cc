@@ -43,6 +43,7 @@ effort (for example the reengineering of a great many Capstone chips).
 #ifndef HAVE_SHA1INIT
 
 #include "sha1_own.h"
+#include "hashes_x86.h"
 
 #define EXTRACT_UCHAR(p) (*(unsigned char *)(p))
 #define STRING2INT(s) (static_cast<uint32_t>((((((EXTRACT_UCHAR(s) << 8) | EXTRACT_UCHAR(s + 1)) << 8) | EXTRACT_UCHAR(s + 2)) << 8) | EXTRACT_UCHAR(s + 3)))
@@ -285,6 +286,18 @@ SHA1Update(SHA1_CTX *ctx, const unsigned char *buffer, unsigned int len) {
 	    len -= left;
 	}
     }
+#ifdef HAVE_X86_HASH_INTRINSICS
+    if (len >= SHA_DATASIZE && hashes_x86_have_sha1()) {
+	unsigned int blocks = len / SHA_DATASIZE;
+
+	hashes_x86_sha1_blocks(ctx->digest, buffer, blocks);
+	ctx->count_l += blocks;
+	if (ctx->count_l < blocks)
+	    ++ctx->count_h;
+	buffer += blocks * SHA_DATASIZE;
+	len -= blocks * SHA_DATASIZE;
+    }
+#endif
     while (len >= SHA_DATASIZE) {
 	sha_block(ctx, buffer);
 	buffer += SHA_DATASIZE;
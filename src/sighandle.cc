@@ -34,10 +34,16 @@
 #include "sighandle.h"
 
 #include <csignal>
+#include <cstdio>
 
+#include <unistd.h>
+
+#include "CkmameCache.h"
+#include "Exception.h"
 #include "globals.h"
 
 volatile int siginfo_caught;
+volatile int interrupt_caught;
 
 void sighandle(int signo) {
     switch (signo) {
@@ -46,12 +52,51 @@ void sighandle(int signo) {
         siginfo_caught = 1;
         break;
 #endif
+    case SIGINT:
+    case SIGTERM:
+        if (interrupt_caught) {
+            /* second interrupt: don't wait any longer */
+            signal(signo, SIG_DFL);
+            raise(signo);
+        }
+        interrupt_caught = signo;
+        break;
     default:
         break;
     }
 }
 
 
+/* Called where it's safe to stop: commit pending cache database writes, then exit with status 128 + signal number. */
+void exit_if_interrupted() {
+    if (!interrupt_caught) {
+        return;
+    }
+
+    /* another interrupt while shutting down terminates immediately */
+    restore_interrupt_handlers();
+
+    if (ckmame_cache) {
+        try {
+            ckmame_cache->flush_databases(false);
+        }
+        catch (Exception &e) {
+            output.error("can't write cache database: %s", e.what());
+        }
+    }
+
+    fflush(nullptr);
+    /* don't run destructors, worker threads may still be running */
+    _exit(128 + interrupt_caught);
+}
+
+
+void restore_interrupt_handlers() {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+}
+
+
 void print_info(const std::string &message) {
     printf("ckmame: %s", message.c_str());
     if (!configuration.set.empty()) {
@@ -37,8 +37,11 @@
 #include <string>
 
 extern volatile int siginfo_caught;
+extern volatile int interrupt_caught;
 
+void exit_if_interrupted();
 void print_info(const std::string& message);
+void restore_interrupt_handlers();
 void sighandle(int);
 
 #endif // HAD_SIGHANDLE_H
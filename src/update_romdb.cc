@@ -31,18 +31,31 @@
   IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include "config.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
 #include "update_romdb.h"
 
 #include "DatRepository.h"
 #include "Exception.h"
 #include "globals.h"
 #include "OutputContext.h"
+#include "OutputContextBuffer.h"
+#include "OutputContextDb.h"
 #include "RomDB.h"
 #include "ParserSourceZip.h"
 #include "ParserSourceFile.h"
 #include "Parser.h"
+#include "WorkerPool.h"
+#if defined(HAVE_LIBXML2)
+#include "XmlProcessor.h"
+#endif
 
-static bool is_romdb_up_to_date(std::vector<DatDB::DatInfo> &dats_to_use) {
+/* If the database contains the same dats in the same order, changed_dats is set to the indices of the dats that are out of date. */
+static bool is_romdb_up_to_date(std::vector<DatDB::DatInfo> &dats_to_use, std::vector<size_t> &changed_dats) {
     auto repository = DatRepository(configuration.dat_directories);
 
     auto up_to_date = true;
@@ -63,7 +76,10 @@ static bool is_romdb_up_to_date(std::vector<DatDB::DatInfo> &dats_to_use) {
 
     // TODO: remove duplicates from dats
 
-    for (const auto &dat_name : configuration.dats) {
+    auto same_dats = db_dats.size() == configuration.dats.size();
+
+    for (size_t i = 0; i < configuration.dats.size(); i++) {
+	const auto &dat_name = configuration.dats[i];
 	auto it = db_versions.find(dat_name);
 	auto fs_dat_maybe = repository.find_dat(dat_name);
 	if (!fs_dat_maybe.has_value()) {
@@ -73,6 +89,10 @@ static bool is_romdb_up_to_date(std::vector<DatDB::DatInfo> &dats_to_use) {
 
 	dats_to_use.push_back(fs_dat);
 
+	if (same_dats && db_dats[i].name != dat_name) {
+	    same_dats = false;
+	}
+
 	if (it == db_versions.end()) {
 	    output.message("%s (-> %s)", dat_name.c_str(), fs_dat.version.c_str());
 	    up_to_date = false;
@@ -83,59 +103,194 @@ static bool is_romdb_up_to_date(std::vector<DatDB::DatInfo> &dats_to_use) {
 	if (DatRepository::is_newer(fs_dat.version, db_version)) {
 	    output.message("%s (%s -> %s)", dat_name.c_str(), db_version.c_str(), fs_dat.version.c_str());
 	    up_to_date = false;
+	    changed_dats.push_back(i);
 	}
     }
 
+    if (!same_dats) {
+	changed_dats.clear();
+    }
+
     // TODO: check that no additional dats are in db
 
     return up_to_date;
 }
 
 
-bool update_romdb(bool force) {
+static std::string parse_error_message(const DatDB::DatInfo &dat) {
+    auto message = "can't parse '" + dat.file_name + "'";
+    if (!dat.entry_name.empty()) {
+	message += "/" + dat.entry_name;
+    }
+    return message;
+}
+
+
+static void parse_dat(const DatDB::DatInfo &dat, OutputContext *output_context) {
+    ParserSourcePtr source;
+
+    if (dat.entry_name.empty()) {
+	source = std::make_shared<ParserSourceFile>(dat.file_name);
+    }
+    else {
+	int error_code;
+	auto zip_archive = zip_open(dat.file_name.c_str(), 0, &error_code);
+	if (zip_archive == nullptr) {
+	    zip_error_t error;
+	    zip_error_init_with_code(&error, error_code);
+	    auto message = "can't open '" + dat.file_name + "': " + zip_error_strerror(&error);
+	    zip_error_fini(&error);
+	    throw Exception(message);
+	}
+	source = std::make_shared<ParserSourceZip>(dat.file_name, zip_archive, dat.entry_name);
+    }
+
+    auto options = Parser::Options();
+    options.game_name_suffix = configuration.dat_game_name_suffix(dat.name);
+    options.use_description_as_name = configuration.dat_use_description_as_name(dat.name);
+    if (!Parser::parse(source, {}, nullptr, output_context, options)) {
+	throw Exception(parse_error_message(dat));
+    }
+}
+
+
+class ParsedDat {
+  public:
+    ParsedDat() : done(false) { }
+
+    bool done; // protected by mutex in parse_dats_parallel()
+    OutputContextBuffer games;
+    std::string messages;
+    std::string error;
+};
+
+
+/* Parse dats in worker threads; games are added to the database in dat order by the calling thread as soon as each dat is parsed, while later dats are still being parsed. */
+static void parse_dats_parallel(const std::vector<DatDB::DatInfo> &dats, OutputContext *output_context) {
+#if defined(HAVE_LIBXML2)
+    XmlProcessor::init();
+#endif
+
+    /* keep at most two parsed dats per thread in memory */
+    auto window = 2 * configuration.jobs;
+
+    /* declared before pool, so they outlive jobs still running if adding games fails */
+    std::vector<std::unique_ptr<ParsedDat>> results(dats.size());
+    std::mutex mutex;
+    std::condition_variable dat_done;
+
+    auto pool = WorkerPool(configuration.jobs);
+    size_t next_dat = 0;
+
+    for (size_t i = 0; i < dats.size(); i++) {
+	for (; next_dat < dats.size() && next_dat < i + window; next_dat++) {
+	    results[next_dat] = std::make_unique<ParsedDat>();
+	    auto dat = &dats[next_dat];
+	    auto result = results[next_dat].get();
+	    pool.add([dat, result, &mutex, &dat_done]() {
+		{
+		    Output::Capture capture;
+		    try {
+			parse_dat(*dat, &result->games);
+		    }
+		    catch (std::exception &ex) {
+			result->error = ex.what();
+		    }
+		    result->messages = std::move(capture.messages);
+		}
+		{
+		    std::lock_guard<std::mutex> lock(mutex);
+		    result->done = true;
+		}
+		dat_done.notify_all();
+	    });
+	}
+
+	{
+	    std::unique_lock<std::mutex> lock(mutex);
+	    dat_done.wait(lock, [&results, i]() { return results[i]->done; });
+	}
+
+	auto result = std::move(results[i]);
+	fputs(result->messages.c_str(), stderr);
+	if (!result->error.empty()) {
+	    throw Exception(result->error);
+	}
+	if (!result->games.replay(output_context)) {
+	    throw Exception(parse_error_message(dats[i]));
+	}
+    }
+
+    pool.wait();
+}
+
+
+/* Replace only the games from changed dats in the existing database. Returns false if that's not possible, leaving the database unchanged. */
+static bool update_romdb_incremental(const std::vector<DatDB::DatInfo> &dats, const std::vector<size_t> &changed_dats, int output_flags) {
+    /* messages are only shown if the update succeeds, otherwise they're repeated by the full rebuild */
+    Output::Capture capture;
+    std::unique_ptr<OutputContextDb> output_context;
+
+    try {
+	output_context = std::make_unique<OutputContextDb>(configuration.rom_db, output_flags | OUTPUT_FL_UPDATE);
+    }
+    catch (std::exception &) {
+	return false;
+    }
+
+    auto ok = true;
+    try {
+	for (auto index : changed_dats) {
+	    if (!output_context->replace_dat(index)) {
+		ok = false;
+		break;
+	    }
+	    parse_dat(dats[index], output_context.get());
+	}
+    }
+    catch (std::exception &) {
+	ok = false;
+    }
+
+    if (!ok) {
+	output_context->error_occurred();
+    }
+    if (!output_context->close() || !ok) {
+	return false;
+    }
+
+    fputs(capture.messages.c_str(), stderr);
+    return true;
+}
+
+
+bool update_romdb(bool force, int output_flags) {
     if (configuration.dats.empty() || configuration.dat_directories.empty()) {
 	return false;
     }
 
     std::vector<DatDB::DatInfo> dats_to_use;
+    std::vector<size_t> changed_dats;
 
-    if (is_romdb_up_to_date(dats_to_use) && !force) {
+    if (is_romdb_up_to_date(dats_to_use, changed_dats) && !force) {
 	return false;
     }
 
+    if (!force && !changed_dats.empty() && update_romdb_incremental(dats_to_use, changed_dats, output_flags)) {
+	return true;
+    }
+
     OutputContextPtr output;
 
     try {
-	output = OutputContext::create(OutputContext::FORMAT_DB, configuration.rom_db, 0);
-
-	for (const auto &dat : dats_to_use) {
-	    ParserSourcePtr source;
-
-	    if (dat.entry_name.empty()) {
-		source = std::make_shared<ParserSourceFile>(dat.file_name);
-	    }
-	    else {
-		int error_code;
-		auto zip_archive = zip_open(dat.file_name.c_str(), 0, &error_code);
-		if (zip_archive == nullptr) {
-		    zip_error_t error;
-		    zip_error_init_with_code(&error, error_code);
-		    auto message = "can't open '" + dat.file_name + "': " + zip_error_strerror(&error);
-		    zip_error_fini(&error);
-		    throw Exception(message);
-		}
-		source = std::make_shared<ParserSourceZip>(dat.file_name, zip_archive, dat.entry_name);
-	    }
+	output = OutputContext::create(OutputContext::FORMAT_DB, configuration.rom_db, output_flags);
 
-	    auto options = Parser::Options();
-	    options.game_name_suffix = configuration.dat_game_name_suffix(dat.name);
-	    options.use_description_as_name = configuration.dat_use_description_as_name(dat.name);
-	    if (!Parser::parse(source, {}, nullptr, output.get(), options)) {
-		auto message = "can't parse '" + dat.file_name + "'";
-		if (!dat.entry_name.empty()) {
-		    message += "/" + dat.entry_name;
-		}
-		throw Exception(message);
+	if (configuration.jobs > 1 && dats_to_use.size() > 1) {
+	    parse_dats_parallel(dats_to_use, output.get());
+	}
+	else {
+	    for (const auto &dat : dats_to_use) {
+		parse_dat(dat, output.get());
 	    }
 	}
 
@@ -34,6 +34,6 @@
   IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
-bool update_romdb(bool force = false);
+bool update_romdb(bool force = false, int output_flags = 0);
 
 #endif // CKMAME_UPDATE_ROMDB_H
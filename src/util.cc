@@ -33,12 +33,14 @@
 
 #include "util.h"
 
+#include <algorithm>
 #include <cctype>
 #include <cinttypes>
 #include <cstdio>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <thread>
 #include <vector>
 
 #include "CkmameDB.h"
@@ -48,6 +50,7 @@
 #include "globals.h"
 #include "SharedFile.h"
 
+#define MAX_JOBS_PER_CORE 4
 
 #define BIN2HEX(n) ((n) >= 10 ? (n) + 'a' - 10 : (n) + '0')
 
@@ -99,10 +102,17 @@ name_type_t name_type(const std::string &name) {
         }
     }
 
-    auto filename = std::filesystem::path(name).filename();
-    if (filename == CkmameDB::db_name || filename == DatDB::db_name || filename == ".DS_Store" || filename.string().substr(0, 2) == "._") {
+    auto filename = std::filesystem::path(name).filename().string();
+    if (filename == CkmameDB::db_name || filename == DatDB::db_name || filename == ".DS_Store" || filename.substr(0, 2) == "._") {
         return NAME_IGNORE;
     }
+    /* SQLite journal files of an open cache database */
+    if (filename.substr(0, CkmameDB::db_name.size()) == CkmameDB::db_name) {
+        auto suffix = filename.substr(CkmameDB::db_name.size());
+        if (suffix == "-wal" || suffix == "-shm" || suffix == "-journal") {
+            return NAME_IGNORE;
+        }
+    }
     
     if (configuration.roms_zipped && is_ziplike(name)) {
 	return NAME_ZIP;
@@ -168,6 +178,95 @@ bool is_ziplike(const std::string &fname) {
 }
 
 
+/* std::stoul accepts leading whitespace and signs, and negates negative numbers */
+static bool starts_with_digit(const std::string &s) {
+    return !s.empty() && isdigit(static_cast<unsigned char>(s[0]));
+}
+
+
+size_t count_from_string(const std::string &s) {
+    size_t count;
+
+    try {
+        size_t end;
+        if (!starts_with_digit(s)) {
+            throw std::invalid_argument(s);
+        }
+        count = std::stoul(s, &end);
+        if (end != s.length()) {
+            throw std::invalid_argument(s);
+        }
+    }
+    catch (std::exception &e) {
+        throw Exception("invalid number '" + s + "'");
+    }
+
+    return count;
+}
+
+
+// 0 means one job per CPU core
+size_t jobs_from_string(const std::string &s) {
+    auto jobs = count_from_string(s);
+
+    auto cores = static_cast<size_t>(std::max(std::thread::hardware_concurrency(), 1u));
+    if (jobs == 0) {
+        jobs = cores;
+    }
+    else if (jobs > MAX_JOBS_PER_CORE * cores) {
+        throw Exception("number of jobs '%s' too large, at most %zu allowed", s.c_str(), MAX_JOBS_PER_CORE * cores);
+    }
+
+    return jobs;
+}
+
+
+// accepts optional suffix k, m, or g (binary units)
+size_t size_from_string(const std::string &s) {
+    size_t size;
+
+    try {
+        size_t end;
+        if (!starts_with_digit(s)) {
+            throw std::invalid_argument(s);
+        }
+        size = std::stoul(s, &end);
+        if (end + 1 == s.length()) {
+            size_t multiplier = 1;
+            switch (s[end]) {
+                case 'g':
+                case 'G':
+                    multiplier *= 1024;
+                    [[fallthrough]];
+                case 'm':
+                case 'M':
+                    multiplier *= 1024;
+                    [[fallthrough]];
+                case 'k':
+                case 'K':
+                    multiplier *= 1024;
+                    break;
+
+                default:
+                    throw std::invalid_argument(s);
+            }
+            if (size > SIZE_MAX / multiplier) {
+                throw std::out_of_range(s);
+            }
+            size *= multiplier;
+        }
+        else if (end != s.length()) {
+            throw std::invalid_argument(s);
+        }
+    }
+    catch (std::exception &e) {
+        throw Exception("invalid size '" + s + "'");
+    }
+
+    return size;
+}
+
+
 std::string human_number(uint64_t value) {
     char s[128];
     if (value > 1024ul * 1024 * 1024 * 1024) {
@@ -187,6 +286,28 @@ std::string human_number(uint64_t value) {
 }
 
 
+/* Absolute path without . or .. components or trailing separator. */
+std::filesystem::path normalized_path(const std::filesystem::path &path) {
+    std::error_code ec;
+    auto normalized = std::filesystem::absolute(path, ec);
+    if (ec) {
+        normalized = path;
+    }
+    normalized = normalized.lexically_normal();
+    if (!normalized.has_filename() && normalized.has_relative_path()) {
+        normalized = normalized.parent_path();
+    }
+    return normalized;
+}
+
+
+/* Whether one normalized path is the same as or inside the other. */
+bool paths_overlap(const std::filesystem::path &a, const std::filesystem::path &b) {
+    auto mismatch = std::mismatch(a.begin(), a.end(), b.begin(), b.end());
+    return mismatch.first == a.end() || mismatch.second == b.end();
+}
+
+
 std::string string_format(const char *format, ...) {
     va_list ap;
     va_start(ap, format);
@@ -58,6 +58,11 @@ void ensure_directory(const std::filesystem::path& name, bool strip_filename = f
 bool is_ziplike(const std::string &fname);
 std::filesystem::path home_directory();
 std::string human_number(uint64_t value);
+std::filesystem::path normalized_path(const std::filesystem::path &path);
+bool paths_overlap(const std::filesystem::path &a, const std::filesystem::path &b);
+size_t count_from_string(const std::string &s);
+size_t jobs_from_string(const std::string &s);
+size_t size_from_string(const std::string &s);
 std::string format_time(const std::string &format, time_t timestamp);
 std::string string_format(const char *format, ...) PRINTF_LIKE(1, 2);
 std::string string_format_v(const char *format, va_list ap);